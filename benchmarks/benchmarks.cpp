@@ -0,0 +1,134 @@
+#include <benchmark/benchmark.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../dispatcher.h"
+
+// Handlers deliberately do nothing so the numbers isolate dispatch cost.
+static void noop0() { }
+static void noop1(int) { }
+static void noop2(int, int) { }
+static void noop4(int, int, int, int) { }
+static void noop8(int, int, int, int, int, int, int, int) { }
+
+// Builds a tree of num_commands leaves spread across a two-level hierarchy with the requested
+// fan-out, optionally aliasing every segment, roughly matching a large auto-generated CLI.
+static void build_tree(Dispatcher& d, int num_commands, int fan_out, bool aliases) {
+    for(int i = 0; i < num_commands; i++) {
+        std::string group = "group" + std::to_string(i % fan_out);
+        std::string leaf = "cmd" + std::to_string(i);
+
+        d.add_command({group, leaf}, noop1);
+
+        if(aliases) {
+            d.add_alias({group, leaf}, "c" + std::to_string(i));
+        }
+    }
+}
+
+static void BM_TraverseHit(benchmark::State& state) {
+    Dispatcher d;
+    build_tree(d, state.range(0), 8, false);
+
+    std::string leaf = "cmd" + std::to_string(state.range(0) - 1);
+    std::string group = "group" + std::to_string((state.range(0) - 1) % 8);
+    const char* argv[] = {"bench", group.c_str(), leaf.c_str(), "1"};
+
+    for(auto _ : state) {
+        d.execute_command(4, argv);
+    }
+}
+BENCHMARK(BM_TraverseHit)->Arg(10)->Arg(100)->Arg(1000)->Arg(10000);
+
+static void BM_TraverseHitAliased(benchmark::State& state) {
+    Dispatcher d;
+    build_tree(d, state.range(0), 8, true);
+
+    std::string leaf = "c" + std::to_string(state.range(0) - 1);
+    std::string group = "group" + std::to_string((state.range(0) - 1) % 8);
+    const char* argv[] = {"bench", group.c_str(), leaf.c_str(), "1"};
+
+    for(auto _ : state) {
+        d.execute_command(4, argv);
+    }
+}
+BENCHMARK(BM_TraverseHitAliased)->Arg(100)->Arg(10000);
+
+static void BM_TraverseMiss(benchmark::State& state) {
+    Dispatcher d;
+    build_tree(d, state.range(0), 8, false);
+    d.add_default_invalid_command_message("no");
+
+    std::stringstream sink;
+    std::streambuf* orig = std::cout.rdbuf(sink.rdbuf());
+
+    const char* argv[] = {"bench", "group0", "nonexistent"};
+    for(auto _ : state) {
+        d.execute_command(3, argv);
+        sink.str("");
+    }
+
+    std::cout.rdbuf(orig);
+}
+BENCHMARK(BM_TraverseMiss)->Arg(100)->Arg(10000);
+
+// Suggestion cost on miss: levenshtein over every sibling name.
+static void BM_SuggestionMiss(benchmark::State& state) {
+    Dispatcher d;
+    build_tree(d, state.range(0), 1, false);
+
+    std::stringstream sink;
+    std::streambuf* orig = std::cout.rdbuf(sink.rdbuf());
+
+    const char* argv[] = {"bench", "group0", "cmd999999x"};
+    for(auto _ : state) {
+        d.execute_command(3, argv);
+        sink.str("");
+    }
+
+    std::cout.rdbuf(orig);
+}
+BENCHMARK(BM_SuggestionMiss)->Arg(100)->Arg(1000);
+
+template<auto Func, int Argc>
+static void BM_ExecuteArgs(benchmark::State& state) {
+    Dispatcher d;
+    d.add_command({"run"}, Func);
+
+    const char* argv[] = {"bench", "run", "1", "2", "3", "4", "5", "6", "7", "8"};
+    for(auto _ : state) {
+        d.execute_command(2 + Argc, argv);
+    }
+}
+BENCHMARK_TEMPLATE(BM_ExecuteArgs, &noop0, 0);
+BENCHMARK_TEMPLATE(BM_ExecuteArgs, &noop1, 1);
+BENCHMARK_TEMPLATE(BM_ExecuteArgs, &noop2, 2);
+BENCHMARK_TEMPLATE(BM_ExecuteArgs, &noop4, 4);
+BENCHMARK_TEMPLATE(BM_ExecuteArgs, &noop8, 8);
+
+static void BM_FlagHeavy(benchmark::State& state) {
+    Dispatcher d;
+    d.add_command({"deploy"}, noop8);
+    for(int i = 0; i < 8; i++) {
+        d.add_positional_flag({"deploy"}, i, "f" + std::to_string(i));
+    }
+
+    const char* argv[] = {"bench", "deploy",
+        "-f0", "0", "-f1", "1", "-f2", "2", "-f3", "3",
+        "-f4", "4", "-f5", "5", "-f6", "6", "-f7", "7"};
+    for(auto _ : state) {
+        d.execute_command(18, argv);
+    }
+}
+BENCHMARK(BM_FlagHeavy);
+
+static void BM_ShellLoop(benchmark::State& state) {
+    Dispatcher d;
+    build_tree(d, 1000, 8, false);
+
+    for(auto _ : state) {
+        d.execute_line("group1 cmd1 42");
+    }
+}
+BENCHMARK(BM_ShellLoop);
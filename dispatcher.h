@@ -1,26 +1,151 @@
 #ifndef DISPATCHER_H
 #define DISPATCHER_H
 
+#include <algorithm>
 #include <any>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
 #include <functional>
+#include <future>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <tuple>
 #include <typeindex>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
+#include <variant>
 #include <vector>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 class Dispatcher {
-private:
+public:
     using InvalidArgsFunc = std::function<void(std::vector<std::string>&, std::vector<bool>&, std::vector<std::string>&, std::vector<std::string>&)>;
     using InvalidCommandFunc = std::function<void(std::vector<std::string>&, std::vector<std::string>&, std::string&)>;
 
+private:
+    /// Intern table for path segments, aliases, and flag names: each distinct name is stored
+    /// once and referenced by a dense int symbol, so hot-path lookups hash the input token once
+    /// and everything after that is an integer compare.
+    struct symbol_table_t {
+        std::deque<std::string> storage; ///< Owns every distinct name; deque so views stay stable.
+
+        std::unordered_map<std::string_view, int> ids; ///< Views into storage mapped to symbols.
+
+        symbol_table_t() = default;
+
+        /// Copies rebuild ids from their own storage: the source's keys are views into the
+        /// source's deque and would dangle once it goes away.
+        symbol_table_t(const symbol_table_t& other) : storage(other.storage) {
+            ids.reserve(storage.size());
+            for(int i = 0; i < storage.size(); i++) {
+                ids[storage[i]] = i;
+            }
+        }
+
+        symbol_table_t& operator=(const symbol_table_t& other) {
+            if(this != &other) {
+                *this = symbol_table_t(other);
+            }
+
+            return *this;
+        }
+
+        symbol_table_t(symbol_table_t&&) = default;
+        symbol_table_t& operator=(symbol_table_t&&) = default;
+
+        int find(std::string_view s) const {
+            auto it = ids.find(s);
+            return it == ids.end() ? -1 : it->second;
+        }
+
+        int intern(std::string_view s) {
+            int id = find(s);
+            if(id != -1) {
+                return id;
+            }
+
+            storage.push_back(std::string(s));
+            id = storage.size() - 1;
+            ids[storage.back()] = id;
+            return id;
+        }
+
+        const std::string& name(int id) const {
+            return storage[id];
+        }
+    };
+
+    /// Typed argument value. The built-in int/float/double/std::string cases live inline in the
+    /// variant so common signatures never touch the heap; anything else falls back to std::any.
+    struct value_t {
+        std::variant<std::monostate, int, float, double, std::string, std::any> v;
+
+        value_t() = default;
+        value_t(int x) : v(x) { }
+        value_t(float x) : v(x) { }
+        value_t(double x) : v(x) { }
+        value_t(std::string s) : v(std::move(s)) { }
+
+        template<typename T>
+        static value_t box(T val) {
+            if constexpr(std::is_same_v<T, int> || std::is_same_v<T, float> || std::is_same_v<T, double> || std::is_same_v<T, std::string>) {
+                return value_t(std::move(val));
+            }
+            else {
+                value_t res;
+                res.v = std::any(std::move(val));
+                return res;
+            }
+        }
+
+        bool has_value() const {
+            if(std::holds_alternative<std::monostate>(v)) {
+                return false;
+            }
+            if(const std::any* a = std::get_if<std::any>(&v)) {
+                return a->has_value();
+            }
+
+            return true;
+        }
+
+        /// T may be cv-/ref-qualified (e.g. a const std::string& handler parameter); the
+        /// variant always holds the decayed type, and references bind into the variant itself.
+        template<typename T>
+        T unbox() {
+            using decayed_t = std::decay_t<T>;
+            if constexpr(std::is_same_v<decayed_t, int> || std::is_same_v<decayed_t, float> || std::is_same_v<decayed_t, double> || std::is_same_v<decayed_t, std::string>) {
+                return std::get<decayed_t>(v);
+            }
+            else {
+                return std::any_cast<decayed_t&>(std::get<std::any>(v));
+            }
+        }
+    };
+
     struct arg_t {
-        std::unordered_map<std::string, std::any> flags; ///< Set of flags which specify a specific argument configuration.
+        std::map<int, value_t> flags; ///< Flag symbols which specify a specific argument configuration.
 
-        std::any def; ///< Possible default value if no other values are added.
+        value_t def; ///< Possible default value if no other values are added.
 
         std::string name; ///< Name of the argument.
 
@@ -28,16 +153,24 @@ private:
 
         template<typename T>
         arg_t(T&&) : type(typeid(T)) { }
+
+        arg_t(std::type_index t) : type(t) { }
     };
 
     struct dispatch_node_t {
-        std::function<void(std::vector<std::any>&)> execute; ///< Wrapper function to execute arguments on previously provided function.
+        std::function<void(std::vector<value_t>&)> execute; ///< Wrapper function to execute arguments on previously provided function.
 
         int num_args; ///< The number of arguments for a function.
 
-        std::vector<arg_t> args; ///< Metadata on function arguments.
+        bool variadic = false; ///< Whether the last argument is a vector tail absorbing all remaining positionals.
+
+        std::vector<arg_t> args; ///< Metadata on function arguments; for variadic commands the last entry carries the element type.
+
+        std::vector<std::pair<std::vector<int>, int>> next; ///< List of next node arena indices with path name and alias symbols.
 
-        std::vector<std::pair<std::vector<std::string>, dispatch_node_t*>> next; ///< List of next nodes with path names and aliases.
+        std::map<int, int> index; ///< Index over every name and alias symbol in next; integer keys only.
+
+        std::map<int, std::pair<int, value_t>> flag_index; ///< Flag symbol -> (argument index, flag value), spanning all arguments.
 
         std::string invalid_command_msg = ""; ///< Invalid command message.
 
@@ -47,24 +180,20 @@ private:
 
         std::function<void(std::vector<std::string>&, std::vector<bool>&, std::vector<std::string>&, std::vector<std::string>&)> invalid_args_func; ///< Function to run on invalid arguments
 
-        dispatch_node_t* find_next(std::string& name) {
-            for(int i = 0; i < next.size(); i++) {
-                std::vector<std::string>& names = next[i].first;
-
-                for(std::string& s : names) {
-                    if(s == name) {
-                        return next[i].second;
-                    }
-                }
-            }
+        int find_next(int sym) {
+            auto it = index.find(sym);
+            return it == index.end() ? -1 : it->second;
+        }
 
-            return nullptr;
+        void add_next(int sym, int node) {
+            index[sym] = node;
+            next.push_back({{sym}, node});
         }
 
-        std::vector<std::string> get_next() {
+        std::vector<std::string> get_next(symbol_table_t& symbols) {
             std::vector<std::string> res;
             for(auto& p : next) {
-                res.push_back(p.first[0]);
+                res.push_back(symbols.name(p.first[0]));
             }
 
             return res;
@@ -79,523 +208,2460 @@ private:
             return res;
         }
 
-        std::pair<int, std::any> find_flag(std::string& flag) {
-            for(int i = 0; i < num_args; i++) {
-                if(args[i].flags.find(flag) != args[i].flags.end()) {
-                    return {i, args[i].flags[flag]};
-                }
+        std::pair<int, value_t> find_flag(int sym) {
+            auto it = flag_index.find(sym);
+            if(it != flag_index.end()) {
+                return it->second;
+            }
+
+            return {-1, value_t()};
+        }
+
+        void add_flag(int sym, int idx, value_t value) {
+            args[idx].flags[sym] = value;
+            flag_index[sym] = {idx, std::move(value)};
+        }
+
+        void add_default(int idx, value_t def) {
+            args[idx].def = std::move(def);
+        }
+
+        bool add_alias(int name, int alias) {
+            int node = find_next(name);
+            if(node == -1) {
+                return false;
+            }
+
+            for(int i = 0; i < next.size(); i++) {
+                if(next[i].second == node) {
+                    next[i].first.push_back(alias);
+                    index[alias] = node;
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+    };
+
+    /// The tuple holds decayed values — reference parameters bind to its elements when the
+    /// handler is applied, so nothing dangles past the call.
+    template<int N, typename ...Args>
+    static std::tuple<std::decay_t<Args>...> convert_args(std::vector<value_t>& args) {
+        return convert_args_impl<Args...>(args, std::make_index_sequence<N>{});
+    }
+
+    template<typename ...Args, std::size_t ...I>
+    static std::tuple<std::decay_t<Args>...> convert_args_impl(std::vector<value_t>& args, std::index_sequence<I...> seq) {
+        return std::make_tuple(args[I].template unbox<std::decay_t<Args>>()...);
+    }
+
+    /// Last type of a parameter pack; void for an empty pack.
+    template<typename ...Args>
+    struct tail_of { using type = void; };
+
+    template<typename First, typename ...Rest>
+    struct tail_of<First, Rest...> : tail_of<Rest...> { };
+
+    template<typename Last>
+    struct tail_of<Last> { using type = Last; };
+
+    /// Detects a std::vector<T> trailing parameter, the marker for a variadic command.
+    template<typename T>
+    struct vector_tail { static constexpr bool value = false; };
+
+    template<typename T>
+    struct vector_tail<std::vector<T>> {
+        static constexpr bool value = true;
+        using elem_t = T;
+    };
+
+    /// Calls func with the fixed arguments unboxed from their slots and the converted tail
+    /// appended as the final vector parameter.
+    template<typename Tuple, typename FuncT, typename Tail, std::size_t ...I>
+    static void apply_with_tail(const FuncT& func, std::vector<value_t>& args, Tail tail, std::index_sequence<I...>) {
+        func(args[I].template unbox<std::tuple_element_t<I, Tuple>>()..., std::move(tail));
+    }
+
+    /// Builds the type-erased execute thunk for a handler signature. A trailing std::vector<T>
+    /// parameter makes the command variadic: every slot past the fixed ones holds one converted
+    /// tail element, and the thunk collects them with a single exact-size reservation.
+    template<int N, typename ...Args>
+    static std::function<void(std::vector<value_t>&)> make_thunk(std::function<void(Args...)> func) {
+        using last_t = typename tail_of<Args...>::type;
+
+        if constexpr(vector_tail<last_t>::value) {
+            using elem_t = typename vector_tail<last_t>::elem_t;
+
+            return [func = std::move(func)](std::vector<value_t>& args) {
+                last_t tail;
+                tail.reserve(args.size() - (N - 1));
+                for(std::size_t i = N - 1; i < args.size(); i++) {
+                    if(args[i].has_value()) { // slot N-1 stays empty when the tail has no tokens
+                        tail.push_back(args[i].template unbox<elem_t>());
+                    }
+                }
+
+                apply_with_tail<std::tuple<Args...>>(func, args, std::move(tail), std::make_index_sequence<N - 1>{ });
+            };
+        }
+        else {
+            return [func = std::move(func)](std::vector<value_t>& args) {
+                std::apply(func, convert_args<N, Args...>(args));
+            };
+        }
+    }
+
+    std::shared_ptr<std::vector<dispatch_node_t>> arena = std::make_shared<std::vector<dispatch_node_t>>(); ///< All nodes, contiguous in registration order; index 0 is the root. Shared between clones.
+
+    std::unordered_map<int, dispatch_node_t> overlay; ///< Clone-private nodes shadowing (or extending) the shared arena; empty unless this dispatcher diverged from a shared base.
+
+    int node_count = 0; ///< Total nodes visible to this dispatcher, spanning arena and overlay.
+
+    std::shared_ptr<symbol_table_t> symbols = std::make_shared<symbol_table_t>(); ///< Interned path segments, aliases, and flag names shared across the tree (and between clones).
+
+    /// One child edge of the finalized layout: a name or alias symbol and the node it leads
+    /// to, plus the rest of a prefix-compressed chain when the child starts one.
+    struct edge_t {
+        int sym; ///< First segment symbol on this edge.
+        int child; ///< Node one segment in, matching the uncompressed tree shape.
+        int node; ///< Node at the end of the compressed chain (== child when uncompressed).
+        int tail_start; ///< [tail_start, tail_end) span into tails: the chain's remaining symbols.
+        int tail_end;
+    };
+
+    /// Read-only structure-of-arrays traversal layout built by freeze(): every node's child
+    /// edges (names and aliases alike) flattened into one dense array, sorted by symbol within
+    /// each node's span. Chains of pure pass-through nodes — one child, no handler, no flags —
+    /// collapse into a single edge whose remaining segment symbols sit in tails, so deep
+    /// auto-generated paths match in one span lookup plus a symbol-per-segment sweep.
+    /// Traversal binary-searches the span for the current node and never touches the nodes
+    /// themselves — everything cold (arg metadata, defaults, error handlers) stays behind in
+    /// the arena, indexed by the same node IDs.
+    struct frozen_edges_t {
+        std::vector<edge_t> edges;
+        std::vector<int> starts; ///< Per-node [starts[n], starts[n + 1]) span into edges.
+        std::vector<int> tails; ///< Symbol sequences of compressed chains, referenced by edges.
+        std::vector<std::uint64_t> blooms; ///< Per-node Bloom word over edge symbols; a failed probe rejects an unknown segment before the span search.
+        std::vector<std::vector<std::string>> completions; ///< Per-node sorted completion table: child names, aliases, and '-'-prefixed flags.
+    };
+
+    /// Two probe bits derived from a symbol id for the per-node child filters.
+    static std::uint64_t bloom_bits(int sym) {
+        std::uint32_t h = static_cast<std::uint32_t>(sym) * 2654435761u;
+        return (1ull << (h >> 26)) | (1ull << ((h >> 20) & 63));
+    }
+
+    std::shared_ptr<const frozen_edges_t> edge_table; ///< Set by freeze(); shared with clones, never mutated afterwards.
+
+    bool sharing() {
+        return arena.use_count() > 1;
+    }
+
+    /// Read access to a node; overlay entries shadow the shared arena.
+    dispatch_node_t& node_at(int i) {
+        if(!overlay.empty()) {
+            auto it = overlay.find(i);
+            if(it != overlay.end()) {
+                return it->second;
+            }
+        }
+
+        return (*arena)[i];
+    }
+
+    /// Write access to a node; while the arena is shared, the node is first copied into this
+    /// dispatcher's private overlay so siblings never observe the change.
+    dispatch_node_t& node_mut(int i) {
+        auto it = overlay.find(i);
+        if(it != overlay.end()) {
+            return it->second;
+        }
+
+        if(sharing()) {
+            return overlay.emplace(i, (*arena)[i]).first->second;
+        }
+
+        return (*arena)[i];
+    }
+
+    symbol_table_t& syms() {
+        return *symbols;
+    }
+
+    symbol_table_t& syms_mut() {
+        if(symbols.use_count() > 1) {
+            symbols = std::make_shared<symbol_table_t>(*symbols);
+        }
+
+        return *symbols;
+    }
+
+    int new_node() {
+        // once any node lives in the overlay past the arena's end, later allocations must keep
+        // extending the overlay even after sharing ends: an arena push_back would hand out an
+        // index the overlay already owns, and the old entry would shadow the new node
+        if(sharing() || node_count > static_cast<int>(arena->size())) {
+            overlay.emplace(node_count, dispatch_node_t());
+            return node_count++;
+        }
+
+        arena->push_back(dispatch_node_t());
+        node_count = arena->size();
+        return node_count - 1;
+    }
+
+    std::map<std::string, std::function<void(Dispatcher&)>, std::less<>> lazy_factories; ///< Pending subtree factories keyed by top-level path segment.
+
+    /// Runs and discards the pending factory for a top-level segment, if one exists. Called on
+    /// a failed root lookup, so fully-registered paths never pay for the check.
+    bool materialize_lazy(std::string_view name) {
+        auto it = lazy_factories.find(name);
+        if(it == lazy_factories.end()) {
+            return false;
+        }
+
+        std::function<void(Dispatcher&)> factory = std::move(it->second);
+        lazy_factories.erase(it); // erase first so the factory's own registrations recurse cleanly
+
+        factory(*this);
+        return true;
+    }
+
+    // ---- flat binary tree format (save/load) ----
+
+    static void write_u32(std::ostream& out, uint32_t v) {
+        out.write(reinterpret_cast<const char*>(&v), sizeof(v));
+    }
+
+    static void write_str(std::ostream& out, const std::string& s) {
+        write_u32(out, s.size());
+        out.write(s.data(), s.size());
+    }
+
+    /// Serializes a value_t. Only the built-in inline cases round-trip; values boxed in
+    /// std::any have no portable representation and are written as empty.
+    static void write_value(std::ostream& out, const value_t& val) {
+        if(const int* x = std::get_if<int>(&val.v)) {
+            out.put(1);
+            out.write(reinterpret_cast<const char*>(x), sizeof(*x));
+        }
+        else if(const float* x = std::get_if<float>(&val.v)) {
+            out.put(2);
+            out.write(reinterpret_cast<const char*>(x), sizeof(*x));
+        }
+        else if(const double* x = std::get_if<double>(&val.v)) {
+            out.put(3);
+            out.write(reinterpret_cast<const char*>(x), sizeof(*x));
+        }
+        else if(const std::string* x = std::get_if<std::string>(&val.v)) {
+            out.put(4);
+            write_str(out, *x);
+        }
+        else {
+            out.put(0);
+        }
+    }
+
+    /// Cursor over the raw mapped bytes of a saved tree; bounds-checks every read.
+    struct tree_reader_t {
+        const char* data;
+        std::size_t size;
+        std::size_t pos = 0;
+
+        void need(std::size_t n) {
+            if(pos + n > size) {
+                throw std::logic_error("Corrupt dispatch tree file.");
+            }
+        }
+
+        uint32_t u32() {
+            need(4);
+            uint32_t v;
+            std::memcpy(&v, data + pos, 4);
+            pos += 4;
+            return v;
+        }
+
+        char tag() {
+            need(1);
+            return data[pos++];
+        }
+
+        std::string str() {
+            uint32_t n = u32();
+            need(n);
+            std::string s(data + pos, n);
+            pos += n;
+            return s;
+        }
+
+        value_t value() {
+            switch(tag()) {
+                case 1: { need(4); int x; std::memcpy(&x, data + pos, 4); pos += 4; return value_t(x); }
+                case 2: { need(4); float x; std::memcpy(&x, data + pos, 4); pos += 4; return value_t(x); }
+                case 3: { need(8); double x; std::memcpy(&x, data + pos, 8); pos += 8; return value_t(x); }
+                case 4: return value_t(str());
+                default: return value_t();
+            }
+        }
+    };
+
+    void load_from(tree_reader_t& in) {
+        if(in.size < 8 || std::memcmp(in.data, "DSPT", 4) != 0) {
+            throw std::logic_error("Not a dispatch tree file.");
+        }
+        in.pos = 4;
+
+        if(in.u32() != 1) {
+            throw std::logic_error("Unsupported dispatch tree version.");
+        }
+
+        uint32_t file_nodes = in.u32();
+        arena = std::make_shared<std::vector<dispatch_node_t>>();
+        overlay.clear();
+        arena->reserve(file_nodes);
+
+        for(uint32_t n = 0; n < file_nodes; n++) {
+            dispatch_node_t node;
+
+            uint32_t child_count = in.u32();
+            for(uint32_t c = 0; c < child_count; c++) {
+                uint32_t name_count = in.u32();
+                std::vector<int> names(name_count);
+                for(uint32_t i = 0; i < name_count; i++) {
+                    names[i] = syms_mut().intern(in.str());
+                }
+
+                uint32_t child = in.u32();
+                if(child >= file_nodes) {
+                    // byte-level bounds checks can't catch an index past the arena
+                    throw std::logic_error("Corrupt dispatch tree file.");
+                }
+
+                for(int name : names) {
+                    node.index[name] = child;
+                }
+                node.next.push_back({std::move(names), static_cast<int>(child)});
+            }
+
+            uint32_t arg_count = in.u32();
+            node.num_args = arg_count;
+            for(uint32_t a = 0; a < arg_count; a++) {
+                arg_t arg { std::type_index(typeid(void)) }; // real type attached by bind_command
+                arg.name = in.str();
+                arg.def = in.value();
+
+                uint32_t flag_count = in.u32();
+                for(uint32_t f = 0; f < flag_count; f++) {
+                    int flag = syms_mut().intern(in.str());
+                    value_t value = in.value();
+                    node.flag_index[flag] = {static_cast<int>(a), value};
+                    arg.flags[flag] = std::move(value);
+                }
+
+                node.args.push_back(std::move(arg));
+            }
+
+            node.invalid_command_msg = in.str();
+            node.invalid_args_msg = in.str();
+
+            arena->push_back(std::move(node));
+        }
+
+        node_count = arena->size();
+    }
+
+    /// Non-throwing numeric parse straight off the token bytes: no string copy on the success
+    /// path and a cheap empty value_t instead of an exception unwind on malformed input.
+    template<typename T>
+    static value_t convert_builtin(std::string_view s) {
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+        T x;
+        auto [p, ec] = std::from_chars(s.data(), s.data() + s.size(), x);
+        if(ec != std::errc() || p != s.data() + s.size()) {
+            return value_t();
+        }
+        return value_t(x);
+#else
+        // pre-from_chars floating point: fall back to the throwing stdlib parsers
+        try {
+            std::string owned(s);
+            if constexpr(std::is_same_v<T, int>) { return value_t(stoi(owned)); }
+            else if constexpr(std::is_same_v<T, float>) { return value_t(stof(owned)); }
+            else { return value_t(stod(owned)); }
+        }
+        catch(...) {
+            return value_t();
+        }
+#endif
+    }
+
+    std::unordered_map<std::type_index, std::function<value_t(std::string_view)>> conversions {
+        {typeid(int), convert_builtin<int>},
+        {typeid(float), convert_builtin<float>},
+        {typeid(double), convert_builtin<double>},
+        {typeid(std::string), [](std::string_view s) { return value_t(std::string(s)); }}
+    };
+
+    std::unordered_map<std::type_index, std::size_t> cached_types; ///< Types whose conversions are memoized, with their per-thread entry budget.
+
+    value_t convert(std::type_index type, std::string_view s) {
+        auto it = conversions.find(type);
+        if(it == conversions.end()) {
+            throw std::logic_error("Missing proper conversion for argument " + std::string(s) + '.');
+        }
+
+        // memoized path: batch and stream inputs repeat the same literals constantly, so an
+        // expensive user conversion is worth a hash probe. Caches are per-thread (no locking
+        // on the concurrent post-freeze path) and swept wholesale when they outgrow their
+        // budget rather than tracking per-entry recency.
+        auto cit = cached_types.find(type);
+        if(cit != cached_types.end()) {
+            auto& cache = tls_scratch().conv_cache[type];
+            auto hit = cache.find(s);
+            if(hit != cache.end()) {
+                return hit->second;
+            }
+
+            value_t v;
+            try {
+                v = it->second(s);
+            }
+            catch(...) {
+                v = value_t();
+            }
+
+            if(cache.size() >= cit->second) {
+                cache.clear(); // generation sweep: cheap, and hot literals repopulate immediately
+            }
+            cache.emplace(std::string(s), v);
+            return v;
+        }
+
+        try {
+            return it->second(s);
+        }
+        catch(...) {
+            return value_t();
+        }
+    }
+
+    std::string invalid_args_msg;
+
+    std::string invalid_command_msg;
+
+    static std::string path_to_str(const std::vector<std::string>& path, const std::string& delim = " ") {
+        if(path.empty()) {
+            return "";
+        }
+
+        std::string path_str = path[0];
+        for(int i = 1; i < path.size(); i++) {
+            path_str.append(delim + path[i]);
+        }
+
+        return path_str;
+    }
+
+    static void index_failed(int idx, int num_args) {
+        throw std::logic_error("Provided index " + std::to_string(idx) + " too large for " + std::to_string(num_args) + " arguments.");
+    }
+
+    /// Binary search over a node's span of the finalized edge array, behind the node's Bloom
+    /// word — a symbol that is no child of this node usually bails on the probe alone, so
+    /// misses cost less than hits.
+    const edge_t* find_edge(const frozen_edges_t& table, int cur, int sym) {
+        std::uint64_t bits = bloom_bits(sym);
+        if((table.blooms[cur] & bits) != bits) {
+            return nullptr;
+        }
+
+        const edge_t* first = table.edges.data() + table.starts[cur];
+        const edge_t* last = table.edges.data() + table.starts[cur + 1];
+        const edge_t* it = std::lower_bound(first, last, sym,
+            [](const edge_t& e, int s) { return e.sym < s; });
+
+        return it != last && it->sym == sym ? it : nullptr;
+    }
+
+    int find_child(int cur, std::string_view name) {
+        int sym = syms().find(name);
+        if(sym == -1) {
+            return -1;
+        }
+
+        if(edge_table) {
+            const edge_t* e = find_edge(*edge_table, cur, sym);
+            return e ? e->child : -1;
+        }
+
+        return node_at(cur).find_next(sym);
+    }
+
+    /// Resolves the first count segments of path to a node index, throwing on a miss.
+    int traverse_exact(const std::vector<std::string>& path, std::size_t count) {
+        assert_mutable(); // every caller is a registration-time mutator
+        int cur = 0;
+        for(std::size_t i = 0; i < count; i++) {
+            int next = find_child(cur, path[i]);
+
+            if(next == -1 && cur == 0 && materialize_lazy(path[i])) {
+                next = find_child(cur, path[i]);
+            }
+
+            if(next == -1) {
+                throw std::logic_error("Failed to find path: " + path_to_str(path));
+            }
+
+            cur = next;
+        }
+
+        return cur;
+    }
+
+    dispatch_node_t* traverse_entire(const std::vector<std::string>& path) {
+        return &node_mut(traverse_exact(path, path.size()));
+    }
+
+    std::pair<int, int> traverse_until(std::vector<std::string_view>& path) {
+        int cur = 0;
+        int idx;
+
+        // finalized trees have no lazy subtrees left, so the walk touches only the hot edge
+        // array (plus the symbol table); node bodies stay cold until the parse needs them
+        if(edge_table) {
+            const frozen_edges_t& table = *edge_table;
+            for(idx = 0; idx < path.size(); idx++) {
+                if(is_flag_token(path[idx])) {
+                    break;
+                }
+
+                int sym = syms().find(path[idx]);
+                const edge_t* e = sym == -1 ? nullptr : find_edge(table, cur, sym);
+                if(!e) {
+                    break;
+                }
+
+                // a compressed edge matches its whole chain against the following tokens,
+                // one interned symbol comparison per segment
+                int j = idx + 1;
+                bool full = true;
+                for(int k = e->tail_start; k < e->tail_end; k++, j++) {
+                    if(j >= path.size() || is_flag_token(path[j]) || syms().find(path[j]) != table.tails[k]) {
+                        full = false;
+                        break;
+                    }
+                }
+
+                if(!full) {
+                    // partial chain: step node-by-node through the interior so the walk stops
+                    // on the same node the uncompressed tree would
+                    cur = e->child;
+                    for(idx++; idx < path.size() && !is_flag_token(path[idx]); idx++) {
+                        int s = syms().find(path[idx]);
+                        int next = s == -1 ? -1 : node_at(cur).find_next(s);
+                        if(next == -1) {
+                            break;
+                        }
+
+                        cur = next;
+                    }
+
+                    return {idx, cur};
+                }
+
+                cur = e->node;
+                idx = j - 1;
+            }
+
+            return {idx, cur};
+        }
+
+        for(idx = 0; idx < path.size(); idx++) {
+            if(is_flag_token(path[idx])) {
+                break;
+            }
+
+            int next = find_child(cur, path[idx]);
+
+            if(next == -1 && cur == 0 && materialize_lazy(path[idx])) {
+                next = find_child(cur, path[idx]);
+            }
+
+            if(next == -1) {
+                break;
+            }
+
+            cur = next;
+        }
+
+        return {idx, cur};
+    }
+
+    /// Resolves path to a node index, creating missing segments along the way.
+    int drill(const std::vector<std::string>& path) {
+        assert_mutable();
+        int cur = 0;
+        for(int i = 0; i < path.size(); i++) {
+            int next = find_child(cur, path[i]);
+
+            if(next == -1 && cur == 0 && materialize_lazy(path[i])) {
+                next = find_child(cur, path[i]);
+            }
+
+            if(next == -1) {
+                int sym = syms_mut().intern(path[i]);
+                next = new_node(); // may reallocate the arena, so re-index below
+                node_mut(cur).add_next(sym, next);
+            }
+
+            cur = next;
+        }
+
+        return cur;
+    }
+
+    dispatch_node_t* traverse_drill(const std::vector<std::string>& path) {
+        return &node_mut(drill(path));
+    }
+
+    template<int N, typename ...Args>
+    static void install_handler(dispatch_node_t& node, std::function<void(Args...)> func) {
+        node.execute = make_thunk<N, Args...>(std::move(func));
+        node.num_args = N;
+
+        node.args = { arg_t(Args{ })... };
+
+        using last_t = typename tail_of<Args...>::type;
+        if constexpr(vector_tail<last_t>::value) {
+            node.variadic = true;
+            node.args[N - 1].type = std::type_index(typeid(typename vector_tail<last_t>::elem_t));
+        }
+    }
+
+    template<int N, typename ...Args>
+    void add_command_impl(const std::vector<std::string>& path, std::function<void(Args...)> func) {
+        install_handler<N, Args...>(*traverse_drill(path), std::move(func));
+    }
+
+    template<auto Func, typename ...Args>
+    void add_command_static_impl(const std::vector<std::string>& path, void (*)(Args...)) {
+        dispatch_node_t* cur = traverse_drill(path);
+
+        constexpr int N = sizeof...(Args);
+        using last_t = typename tail_of<Args...>::type;
+
+        // captureless, so the execute thunk is a plain function pointer: no std::function
+        // allocation at registration and a direct call to Func baked in at compile time
+        if constexpr(vector_tail<last_t>::value) {
+            using elem_t = typename vector_tail<last_t>::elem_t;
+
+            cur->execute = +[](std::vector<value_t>& args) {
+                last_t tail;
+                tail.reserve(args.size() - (N - 1));
+                for(std::size_t i = N - 1; i < args.size(); i++) {
+                    if(args[i].has_value()) {
+                        tail.push_back(args[i].template unbox<elem_t>());
+                    }
+                }
+
+                apply_with_tail<std::tuple<Args...>>(Func, args, std::move(tail), std::make_index_sequence<N - 1>{ });
+            };
+            cur->variadic = true;
+        }
+        else {
+            cur->execute = +[](std::vector<value_t>& args) {
+                std::apply(Func, convert_args<N, Args...>(args));
+            };
+        }
+        cur->num_args = N;
+
+        cur->args = { arg_t(Args{ })... };
+
+        if constexpr(vector_tail<last_t>::value) {
+            cur->args[N - 1].type = std::type_index(typeid(typename vector_tail<last_t>::elem_t));
+        }
+    }
+
+    /// True for tokens that open the flag region. Empty tokens (argv may contain "") are not
+    /// flags — and must not be indexed, since string_view[0] on an empty view is UB.
+    static bool is_flag_token(std::string_view s) {
+        return !s.empty() && s[0] == '-';
+    }
+
+    static std::string_view trim_flag(std::string_view s) {
+        for(int i = 0; i < s.size(); i++) {
+            if(s[i] != '-') {
+                return s.substr(i);
+            }
+        }
+
+        return s;
+    }
+
+    /// Myers' bit-parallel edit distance: the query (<= 64 chars) is encoded once into the
+    /// per-character bitmask table `peq`, then each candidate is scanned one word operation per
+    /// character. Returns threshold + 1 as soon as the remaining characters cannot pull the
+    /// running score back under the threshold, so far-off candidates cost a few iterations.
+    static int myers_distance(const std::uint64_t* peq, int m, std::string_view text, int threshold) {
+        std::uint64_t pv = ~0ull, mv = 0;
+        std::uint64_t high = 1ull << (m - 1);
+        int score = m, n = text.size();
+
+        for(int j = 0; j < n; j++) {
+            std::uint64_t eq = peq[(unsigned char) text[j]];
+            std::uint64_t xv = eq | mv;
+            std::uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+            std::uint64_t ph = mv | ~(xh | pv);
+            std::uint64_t mh = pv & xh;
+
+            if(ph & high) {
+                score++;
+            }
+            else if(mh & high) {
+                score--;
+            }
+
+            ph = (ph << 1) | 1;
+            mv = ph & xv;
+            pv = (mh << 1) | ~(xv | ph);
+
+            if(score - (n - 1 - j) > threshold) { // each remaining char lowers score by at most 1
+                return threshold + 1;
+            }
+        }
+
+        return score;
+    }
+
+    /// Two-row DP fallback for queries longer than 64 characters, bailing out once an entire
+    /// row exceeds the threshold (every later cell can only grow from the row minimum).
+    static int banded_distance(std::string_view s1, std::string_view s2, int threshold) {
+        int N = s1.size(), M = s2.size();
+        std::vector<int> prev(M + 1), cur(M + 1);
+
+        for(int j = 0; j <= M; j++) {
+            prev[j] = j;
+        }
+
+        for(int i = 1; i <= N; i++) {
+            cur[0] = i;
+            int best = cur[0];
+
+            for(int j = 1; j <= M; j++) {
+                cur[j] = std::min({ prev[j - 1] + (s1[i - 1] != s2[j - 1]), prev[j] + 1, cur[j - 1] + 1 });
+                best = std::min(best, cur[j]);
+            }
+
+            if(best > threshold) {
+                return threshold + 1;
+            }
+
+            std::swap(prev, cur);
+        }
+
+        return prev[M];
+    }
+
+    static std::vector<std::string> find_close(std::vector<std::string>& names, std::string& s, int threshold) {
+        std::vector<std::string> res;
+        int m = s.size();
+
+        // the query's bitmask table is built once and amortized over every candidate
+        std::uint64_t peq[256];
+        bool bit_parallel = m > 0 && m <= 64;
+        if(bit_parallel) {
+            std::memset(peq, 0, sizeof(peq));
+            for(int i = 0; i < m; i++) {
+                peq[(unsigned char) s[i]] |= 1ull << i;
+            }
+        }
+
+        for(std::string& name : names) {
+            int n = name.size();
+            if(n - m > threshold || m - n > threshold) { // length difference alone exceeds the budget
+                continue;
+            }
+
+            int dist;
+            if(m == 0) {
+                dist = n;
+            }
+            else if(bit_parallel) {
+                dist = myers_distance(peq, m, name, threshold);
+            }
+            else {
+                dist = banded_distance(s, name, threshold);
+            }
+
+            if(dist <= threshold) {
+                res.push_back(name);
+            }
+        }
+
+        return res;
+    }
+
+    InvalidCommandFunc invalid_command_func; ///< User-installed override; the buffered built-in renderer runs when empty.
+
+    InvalidArgsFunc invalid_args_func; ///< User-installed override; the buffered built-in renderer runs when empty.
+
+    /// Every diagnostic leaves the dispatcher through this sink as one pre-formatted block, so
+    /// a whole error message costs a single stream write instead of dozens of operator<< calls
+    /// on a tied, synced stream. Replaceable to route errors into a logger.
+    std::function<void(std::string_view)> error_sink = [](std::string_view text) {
+        std::cout.write(text.data(), text.size());
+    };
+
+    /// Renders a one-line message through the sink, reusing the thread-local error buffer.
+    void emit_message(const std::string& msg) {
+        std::string& out = tls_scratch().err;
+        out.assign(msg);
+        out += '\n';
+        error_sink(out);
+    }
+
+    void default_invalid_command(std::vector<std::string>& path, std::vector<std::string>& next, std::string& name) {
+        std::vector<std::string> closest = find_close(next, name, 2);
+
+        std::string& out = tls_scratch().err;
+        out.clear();
+        out += "Unknown command: ";
+        out += path_to_str(path);
+        out += " \033[31m";
+        out += name;
+        out += "\033[30m\n\n";
+
+        if(!closest.empty()) {
+            if(closest.size() == 1) {
+                out += "The most similar command is:\n";
+            }
+            else {
+                out += "Similar commands are:\n";
+            }
+
+            for(std::string& close : closest) {
+                out += '\t';
+                out += close;
+                out += '\n';
+            }
+            out += '\n';
+        }
+        else {
+            out += "Possible commands are:\n";
+            for(std::string& name : next) {
+                out += '\t';
+                out += name;
+                out += '\n';
+            }
+            out += '\n';
+        }
+
+        error_sink(out);
+    }
+
+    void default_invalid_args(std::vector<std::string>& names, std::vector<bool>& converted, std::vector<std::string>& path, std::vector<std::string>& input) {
+        std::string& out = tls_scratch().err;
+        out.clear();
+        out += "Invalid arguments: ";
+        out += path_to_str(path);
+        for(int i = 0; i < converted.size(); i++) {
+            if(!converted[i]) {
+                out += " \033[31m";
+                out += input[i];
+                out += "\033[30m";
+            }
+            else {
+                out += ' ';
+                out += input[i];
+            }
+        }
+        out += '\n';
+
+        out += "\nExpected: ";
+        out += path_to_str(path);
+        out += ' ';
+
+        for(int i = 0; i < names.size(); i++) {
+            if(names[i].empty()) {
+                out += "[arg";
+                out += std::to_string(i + 1);
+                out += ']';
+            }
+            else {
+                out += '[';
+                out += names[i];
+                out += ']';
+            }
+
+            if(i != names.size() - 1) {
+                out += ' ';
+            }
+        }
+        out += "\n\n";
+
+        error_sink(out);
+    }
+
+    /// Prepared binding plan for one command + token shape: maps token positions straight to
+    /// argument slots and records the value-flag presets and defaults that shape needs, so a
+    /// repeat invocation skips the flag scan, attempted bookkeeping, and default-fill pass.
+    struct plan_t {
+        enum kind_t : char { positional = 0, flag_name = 1, flag_value = 2, flag_equals = 3 };
+
+        std::vector<char> kind; ///< Role of each token position.
+
+        std::vector<int> slot; ///< Per token: argument slot it converts into, or -1.
+
+        std::vector<int> sym; ///< Per token: expected flag symbol for flag_name positions, else -1.
+
+        std::vector<std::pair<int, value_t>> presets; ///< Value-flag slots and their stored values.
+
+        std::vector<std::pair<int, value_t>> defaults; ///< Slots this shape fills from defaults.
+
+        static constexpr std::size_t cache_budget = 1024; ///< Per-thread plan count before the cache is swept.
+    };
+
+    /// Identity token mixed into thread-local plan-cache keys. Every dispatcher — clones
+    /// included — draws a fresh value, so a plan recorded against one tree can never match a
+    /// later dispatcher whose allocations happen to reuse the same addresses.
+    struct plan_identity_t {
+        std::uint64_t id = next();
+
+        plan_identity_t() = default;
+        plan_identity_t(const plan_identity_t&) : id(next()) { }
+        plan_identity_t& operator=(const plan_identity_t&) {
+            id = next();
+            return *this;
+        }
+
+        static std::uint64_t next() {
+            static std::atomic<std::uint64_t> counter { 1 };
+            return counter.fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+
+    plan_identity_t plan_identity;
+
+    /// Key of a node's cached plan in the thread-local cache: dispatcher identity in the high
+    /// bits, node index in the low ones.
+    std::uint64_t plan_key(int node_idx) const {
+        return (plan_identity.id << 32) ^ static_cast<std::uint32_t>(node_idx);
+    }
+
+    /// Per-invocation parse state, kept as a member so repeated dispatches (shell mode, batch
+    /// scripts) reuse the same buffers instead of reallocating them every call.
+    struct scratch_t {
+        std::vector<std::string_view> names;
+        std::vector<std::string_view> prefix;
+        std::vector<value_t> args;
+        std::vector<bool> successes;
+        std::vector<std::uint64_t> claimed; ///< Bitmask over argument slots already owned by a flag or positional.
+        std::vector<int> token_slot; ///< Per token: the slot it was booked against, or -1.
+        std::string line;
+        std::string err; ///< Reusable buffer the built-in error renderers format into.
+
+        std::vector<std::string> completion_store; ///< Candidate storage for completion queries on unfrozen trees.
+        std::vector<std::string_view> completion_out; ///< Result buffer handed out by complete().
+
+        std::unordered_map<std::type_index, std::map<std::string, value_t, std::less<>>> conv_cache; ///< Memoized conversion results for types opted in via cache_conversions.
+
+        int node_idx = -1; ///< Arena index of the node the last parse resolved to.
+        int fail = 0; ///< Quiet-mode failure kind: 0 ok, 1 no match, 2 invalid arguments.
+        std::uint64_t convert_ns = 0; ///< Conversion time accumulated across the current parse when stats are enabled.
+
+        std::unordered_map<std::uint64_t, plan_t> plans; ///< Cached binding plans keyed by dispatcher identity + node index.
+        std::vector<char> plan_kind;
+        std::vector<int> plan_slot;
+        std::vector<int> plan_sym;
+        std::vector<std::pair<int, value_t>> plan_presets;
+        std::vector<std::pair<int, value_t>> plan_defaults;
+        bool plan_usable = true; ///< Cleared when the parse contains a shape plans can't express (grouped flags).
+
+        bool is_claimed(int slot) {
+            return (claimed[slot >> 6] >> (slot & 63)) & 1;
+        }
+
+        void claim(int slot) {
+            claimed[slot >> 6] |= 1ull << (slot & 63);
+        }
+
+        void reset(int num_args, int num_tokens) {
+            args.assign(num_args, value_t());
+            successes.assign(num_tokens, false);
+            claimed.assign((num_args + 63) / 64, 0);
+            token_slot.assign(num_tokens, -1);
+
+            plan_kind.assign(num_tokens, plan_t::positional);
+            plan_slot.assign(num_tokens, -1);
+            plan_sym.assign(num_tokens, -1);
+            plan_presets.clear();
+            plan_defaults.clear();
+            plan_usable = true;
+        }
+    };
+
+    /// One scratch per thread: after freeze() the tree is immutable, so concurrent dispatches
+    /// only ever touch their own thread's buffers.
+    static scratch_t& tls_scratch() {
+        thread_local scratch_t scratch;
+        return scratch;
+    }
+
+    bool frozen = false; ///< Set by freeze(); closes registration so dispatch is read-only.
+
+    /// One parsed-and-bound invocation waiting on the work queue. The execute thunk is copied
+    /// in, so the job stays valid even if the dispatcher goes away before it is drained.
+    struct async_job_t {
+        std::function<void(std::vector<value_t>&)> exec;
+        std::vector<value_t> args;
+        std::promise<void> done;
+    };
+
+    /// Work queue and pool shared by all async invocations (and, via shared_ptr, by clones).
+    /// The destructor lets queued jobs drain before the workers exit.
+    struct async_state_t {
+        std::mutex m;
+        std::condition_variable work;
+        std::condition_variable drained;
+        std::deque<async_job_t> jobs;
+        std::vector<std::thread> workers;
+        std::size_t in_flight = 0; ///< Queued plus currently running jobs.
+        bool stop = false;
+
+        ~async_state_t() {
+            {
+                std::unique_lock<std::mutex> lock(m);
+                stop = true;
+            }
+            work.notify_all();
+            for(std::thread& w : workers) {
+                w.join();
+            }
+        }
+    };
+
+    std::shared_ptr<async_state_t> async_state; ///< Created on first async use.
+
+    /// Workers hold a raw pointer on purpose: a shared_ptr here would keep the state (and the
+    /// std::threads it owns) alive forever. The destructor joins every worker before the state
+    /// goes away, so the pointer outlives the loop.
+    static void worker_loop(async_state_t* st) {
+        while(true) {
+            std::unique_lock<std::mutex> lock(st->m);
+            st->work.wait(lock, [&] { return st->stop || !st->jobs.empty(); });
+
+            if(st->jobs.empty()) {
+                return; // stop requested and the queue is drained
+            }
+
+            async_job_t job = std::move(st->jobs.front());
+            st->jobs.pop_front();
+            lock.unlock();
+
+            try {
+                job.exec(job.args);
+                job.done.set_value();
+            }
+            catch(...) {
+                job.done.set_exception(std::current_exception());
+            }
+
+            lock.lock();
+            st->in_flight--;
+            if(st->in_flight == 0) {
+                st->drained.notify_all();
+            }
+        }
+    }
+
+    void ensure_workers(int num_threads) {
+        if(!async_state) {
+            async_state = std::make_shared<async_state_t>();
+        }
+
+        while(async_state->workers.size() < num_threads) {
+            async_state->workers.emplace_back(worker_loop, async_state.get());
+        }
+    }
+
+    /// Moves a successfully parsed invocation onto the work queue. Parse failures were already
+    /// reported through the usual error path, so they resolve to an immediately ready future.
+    std::future<void> enqueue_parsed(dispatch_node_t* cur, scratch_t& scratch) {
+        std::promise<void> done;
+        std::future<void> fut = done.get_future();
+
+        if(!cur) {
+            done.set_value();
+            return fut;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(async_state->m);
+            async_state->jobs.push_back(async_job_t { cur->execute, std::move(scratch.args), std::move(done) });
+            async_state->in_flight++;
+        }
+        async_state->work.notify_one();
+
+        return fut;
+    }
+
+    void assert_mutable() {
+        if(frozen) {
+            throw std::logic_error("Dispatcher is frozen; registration is closed.");
+        }
+    }
+
+#ifndef DISPATCHER_NO_STATS
+    /// Live counters for one node, updated with relaxed atomic adds so instrumented dispatch
+    /// stays safe under the concurrent post-freeze execution model.
+    struct node_stats_t {
+        std::atomic<std::uint64_t> invocations { 0 };
+        std::atomic<std::uint64_t> traverse_ns { 0 };
+        std::atomic<std::uint64_t> bind_ns { 0 };
+        std::atomic<std::uint64_t> convert_ns { 0 };
+        std::atomic<std::uint64_t> execute_ns { 0 };
+        std::atomic<std::uint64_t> execute_hist[24] { }; ///< Power-of-two handler latency buckets.
+    };
+
+    std::shared_ptr<node_stats_t[]> stats_data; ///< One slot per node while stats are enabled, null otherwise; clones share counters.
+    int stats_size = 0;
+
+    static std::uint64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static int hist_bucket(std::uint64_t ns) {
+        int b = 0;
+        while(ns > 1 && b < 23) {
+            ns >>= 1;
+            b++;
+        }
+        return b;
+    }
+
+    node_stats_t* stats_of(int node) {
+        return stats_data && node >= 0 && node < stats_size ? &stats_data[node] : nullptr;
+    }
+
+    /// Books a finished parse against its node: traversal, binding (minus conversion), and the
+    /// conversion time accumulated in scratch.
+    void record_parse(node_stats_t* st, std::uint64_t t0, std::uint64_t t1, scratch_t& scratch) {
+        std::uint64_t end = now_ns();
+        st->traverse_ns.fetch_add(t1 - t0, std::memory_order_relaxed);
+        st->convert_ns.fetch_add(scratch.convert_ns, std::memory_order_relaxed);
+        st->bind_ns.fetch_add(end - t1 - scratch.convert_ns, std::memory_order_relaxed);
+    }
+#endif
+
+#ifndef DISPATCHER_NO_STATS
+    /// Depth-first snapshot walk; forward-declared struct defined in the public section below.
+    template<typename Out>
+    void collect_stats(int node, const std::string& path, std::vector<Out>& res) {
+        if(node < stats_size && node_at(node).execute) {
+            node_stats_t& st = stats_data[node];
+
+            Out out;
+            out.path = path;
+            out.invocations = st.invocations.load(std::memory_order_relaxed);
+            out.traverse_ns = st.traverse_ns.load(std::memory_order_relaxed);
+            out.bind_ns = st.bind_ns.load(std::memory_order_relaxed);
+            out.convert_ns = st.convert_ns.load(std::memory_order_relaxed);
+            out.execute_ns = st.execute_ns.load(std::memory_order_relaxed);
+            for(int b = 0; b < 24; b++) {
+                out.execute_hist[b] = st.execute_hist[b].load(std::memory_order_relaxed);
+            }
+
+            res.push_back(std::move(out));
+        }
+
+        for(auto& p : node_at(node).next) {
+            const std::string& name = syms().name(p.first[0]);
+            collect_stats(p.second, path.empty() ? name : path + " " + name, res);
+        }
+    }
+#endif
+
+    /// Conversion wrapper the parse loops go through; accumulates per-parse conversion time
+    /// when stats are enabled and is a plain convert call otherwise.
+    value_t convert_counted(std::type_index type, std::string_view s, scratch_t& scratch) {
+#ifndef DISPATCHER_NO_STATS
+        if(stats_data) {
+            std::uint64_t t = now_ns();
+            value_t v = convert(type, s);
+            scratch.convert_ns += now_ns() - t;
+            return v;
+        }
+#endif
+        return convert(type, s);
+    }
+
+    /// Splits a line into whitespace-separated tokens viewed in place; no per-token allocation.
+    static void tokenize(std::string_view line, std::vector<std::string_view>& out) {
+        out.clear();
+
+        int i = 0;
+        while(i < line.size()) {
+            while(i < line.size() && (line[i] == ' ' || line[i] == '\t')) i++;
+
+            int start = i;
+            while(i < line.size() && line[i] != ' ' && line[i] != '\t') i++;
+
+            if(i > start) {
+                out.push_back(line.substr(start, i - start));
+            }
+        }
+    }
+
+    static std::vector<std::string> materialize_path(std::string_view prog, std::vector<std::string_view>& names, int idx) {
+        std::vector<std::string> path;
+        path.reserve(idx + 1);
+
+        if(!prog.empty()) {
+            path.push_back(std::string(prog));
+        }
+        for(int i = 0; i < idx; i++) {
+            path.push_back(std::string(names[i]));
+        }
+
+        return path;
+    }
+
+    void dispatch(std::string_view prog, std::vector<std::string_view>& names) {
+        scratch_t& scratch = tls_scratch();
+
+        dispatch_node_t* cur = parse_invocation(prog, names, scratch);
+        if(!cur) {
+            return;
+        }
+
+        execute_parsed(cur, scratch);
+    }
+
+    void execute_parsed(dispatch_node_t* cur, scratch_t& scratch) {
+#ifndef DISPATCHER_NO_STATS
+        if(node_stats_t* st = stats_of(scratch.node_idx)) {
+            std::uint64_t t = now_ns();
+            cur->execute(scratch.args);
+            std::uint64_t ns = now_ns() - t;
+
+            st->invocations.fetch_add(1, std::memory_order_relaxed);
+            st->execute_ns.fetch_add(ns, std::memory_order_relaxed);
+            st->execute_hist[hist_bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+#endif
+        cur->execute(scratch.args);
+    }
+
+    /// Binds a token list through a cached plan. Returns false — leaving the slow path to redo
+    /// the work and report any errors — if the token shape no longer matches the plan or a
+    /// conversion fails.
+    bool try_plan(plan_t& plan, dispatch_node_t* cur, std::vector<std::string_view>& names, scratch_t& scratch) {
+        if(names.size() != plan.kind.size()) {
+            return false;
+        }
+
+        // validate the flag shape: planned flag positions must carry the same flag, and no
+        // positional token may have turned into a known flag
+        for(int i = 0; i < names.size(); i++) {
+            if(plan.kind[i] == plan_t::flag_value) {
+                continue;
+            }
+
+            std::string_view trimmed = trim_flag(names[i]);
+
+            if(plan.kind[i] == plan_t::flag_equals) {
+                std::size_t eq = trimmed.find('=');
+                if(trimmed.size() == names[i].size() || eq == std::string_view::npos
+                    || syms().find(trimmed.substr(0, eq)) != plan.sym[i]) {
+                    return false;
+                }
+                continue;
+            }
+
+            int sym = -1;
+            if(trimmed.size() != names[i].size()) {
+                int found = syms().find(trimmed);
+                if(found != -1 && cur->find_flag(found).first != -1) {
+                    sym = found;
+                }
+            }
+
+            if(plan.kind[i] == plan_t::flag_name ? sym != plan.sym[i] : sym != -1) {
+                return false;
+            }
+        }
+
+        scratch.args.assign(cur->num_args, value_t());
+
+        for(int i = 0; i < names.size(); i++) {
+            if(plan.slot[i] != -1) {
+                std::string_view text = names[i];
+                if(plan.kind[i] == plan_t::flag_equals) {
+                    text = trim_flag(text);
+                    text.remove_prefix(text.find('=') + 1);
+                }
+
+                // tail slots of a variadic command sit past num_args and are appended in order
+                int type_slot = std::min(plan.slot[i], cur->num_args - 1);
+                value_t v = convert_counted(cur->args[type_slot].type, text, scratch);
+                if(!v.has_value()) {
+                    return false;
+                }
+
+                if(plan.slot[i] < scratch.args.size()) {
+                    scratch.args[plan.slot[i]] = std::move(v);
+                }
+                else {
+                    scratch.args.push_back(std::move(v));
+                }
+            }
+        }
+
+        for(auto& p : plan.presets) {
+            scratch.args[p.first] = p.second;
+        }
+        for(auto& p : plan.defaults) {
+            scratch.args[p.first] = p.second;
+        }
+
+        return true;
+    }
+
+    /// Parse phase of a dispatch: traversal, flag resolution, conversion, and default fill.
+    /// Returns the resolved node with scratch.args populated, or nullptr after reporting the
+    /// error. In quiet mode a failure instead records its kind in scratch.fail and returns
+    /// immediately, skipping the suggestion and error machinery entirely. Read-only against
+    /// the tree, so safe to run concurrently once frozen.
+    dispatch_node_t* parse_invocation(std::string_view prog, std::vector<std::string_view>& names, scratch_t& scratch, bool quiet = false) {
+#ifndef DISPATCHER_NO_STATS
+        std::uint64_t t0 = stats_data ? now_ns() : 0;
+#endif
+
+        // get proper dispatch node
+        auto [idx, cur_idx] = traverse_until(names);
+        dispatch_node_t* cur = &node_at(cur_idx);
+        scratch.node_idx = cur_idx;
+
+#ifndef DISPATCHER_NO_STATS
+        std::uint64_t t1 = stats_data ? now_ns() : 0;
+        scratch.convert_ns = 0;
+#endif
+
+        // check if node can execute
+        if(!(cur->execute)) {
+            if(quiet) {
+                scratch.fail = 1;
+                return nullptr;
+            }
+
+            if(cur->invalid_command_func) {
+                std::vector<std::string> path = materialize_path(prog, names, idx);
+                std::vector<std::string> next = cur->get_next(syms());
+                if(cur_idx == 0) {
+                    for(auto& p : lazy_factories) {
+                        next.push_back(p.first);
+                    }
+                }
+
+                std::string name = "";
+                if(idx < names.size()) {
+                    name = std::string(names[idx]);
+                }
+
+                cur->invalid_command_func(path, next, name);
+            }
+            else if(!cur->invalid_command_msg.empty()) {
+                emit_message(cur->invalid_command_msg);
+            }
+            else if(!invalid_command_msg.empty()) {
+                emit_message(invalid_command_msg);
+            }
+            else {
+                std::vector<std::string> path = materialize_path(prog, names, idx);
+                std::vector<std::string> next = cur->get_next(syms());
+                if(cur_idx == 0) {
+                    for(auto& p : lazy_factories) {
+                        next.push_back(p.first);
+                    }
+                }
+
+                std::string name = "";
+                if(idx < names.size()) {
+                    name = std::string(names[idx]);
+                }
+
+                if(invalid_command_func) {
+                    invalid_command_func(path, next, name);
+                }
+                else {
+                    default_invalid_command(path, next, name);
+                }
+            }
+            return nullptr;
+        }
+
+        scratch.prefix.assign(names.begin(), names.begin() + idx);
+        names.erase(names.begin(), names.begin() + idx);
+
+        // prepared-plan fast path: a frozen tree can't invalidate a cached plan
+        if(frozen) {
+            auto pit = scratch.plans.find(plan_key(cur_idx));
+            if(pit != scratch.plans.end() && try_plan(pit->second, cur, names, scratch)) {
+#ifndef DISPATCHER_NO_STATS
+                if(node_stats_t* st = stats_of(cur_idx)) {
+                    record_parse(st, t0, t1, scratch);
+                }
+#endif
+                return cur;
+            }
+        }
+
+        scratch.reset(cur->num_args, names.size());
+        std::vector<value_t>& args = scratch.args;
+        std::vector<bool>& successes = scratch.successes;
+        bool suc = true;
+
+        // classification pre-scan: mark flag tokens and claim their slots, so positionals can
+        // route around slots a later flag owns. No conversion happens here, just symbol lookups
+        // against the node's flag index and bitmask bookkeeping. Equals-form and grouped tokens
+        // are recognized here too; both split into string_view slices of the original token.
+        for(int i = 0; i < names.size(); i++) {
+            std::string_view trimmed = trim_flag(names[i]);
+            if(trimmed.size() == names[i].size()) continue;
+
+            int sym = syms().find(trimmed);
+            if(sym != -1) {
+                auto [slot, value] = cur->find_flag(sym);
+
+                if(slot == -1) {
+                    continue;
+                }
+
+                scratch.claim(slot);
+                scratch.plan_kind[i] = plan_t::flag_name;
+                scratch.plan_sym[i] = sym;
+                scratch.token_slot[i] = slot;
+
+                if(!value.has_value()) {
+                    i++;
+
+                    if(i >= names.size()) {
+                        continue;
+                    }
+
+                    scratch.plan_kind[i] = plan_t::flag_value;
+                    scratch.plan_slot[i] = slot;
+                    scratch.token_slot[i] = slot;
+                }
+                else {
+                    args[slot] = value;
+                    scratch.plan_presets.push_back({slot, value});
+                }
+                continue;
+            }
+
+            // --key=value: the name slice before '=' resolves through the flag index and the
+            // slice after it becomes the flag's value in the binding pass
+            std::size_t eq = trimmed.find('=');
+            if(eq != std::string_view::npos) {
+                sym = syms().find(trimmed.substr(0, eq));
+                if(sym == -1) {
+                    continue;
+                }
+
+                auto [slot, value] = cur->find_flag(sym);
+                if(slot == -1) {
+                    continue;
+                }
+
+                scratch.claim(slot);
+                scratch.plan_kind[i] = plan_t::flag_equals;
+                scratch.plan_sym[i] = sym;
+                scratch.plan_slot[i] = slot;
+                scratch.token_slot[i] = slot;
+                continue;
+            }
+
+            // -abc: every character of a single-dash token must resolve to a flag of this node.
+            // Members with preset values apply in place; only the last member may consume the
+            // next token as its value.
+            if(names[i].size() > 2 && names[i][1] != '-') {
+                bool group = true;
+                for(int k = 0; k < trimmed.size() && group; k++) {
+                    int member = syms().find(trimmed.substr(k, 1));
+                    auto [slot, value] = member == -1 ? std::pair<int, value_t>{-1, value_t()} : cur->find_flag(member);
+                    group = slot != -1 && (value.has_value() || k == trimmed.size() - 1);
+                }
+                if(!group) {
+                    continue;
+                }
+
+                scratch.plan_kind[i] = plan_t::flag_name;
+                for(int k = 0; k < trimmed.size(); k++) {
+                    auto [slot, value] = cur->find_flag(syms().find(trimmed.substr(k, 1)));
+                    scratch.claim(slot);
+                    scratch.token_slot[i] = slot;
+
+                    if(value.has_value()) {
+                        args[slot] = value;
+                    }
+                    else if(i + 1 < names.size()) {
+                        i++;
+                        scratch.plan_kind[i] = plan_t::flag_value;
+                        scratch.plan_slot[i] = slot;
+                        scratch.token_slot[i] = slot;
+                    }
+                }
+
+                // the plan model keys flag tokens on a single symbol, which a group is not
+                scratch.plan_usable = false;
+            }
+        }
+
+        // binding pass: one forward scan converts every flag value and positional straight into
+        // its slot, tracking the next free positional slot monotonically. For variadic commands
+        // the last slot starts the tail: surplus positionals append one slot each, with the
+        // buffer reserved once for the worst case.
+        int fixed = cur->variadic ? cur->num_args - 1 : cur->num_args;
+        int tail_count = 0;
+        if(cur->variadic) {
+            args.reserve(cur->num_args + names.size());
+        }
+
+        for(int i = 0, pos = 0; i < names.size(); i++) {
+            if(scratch.plan_kind[i] == plan_t::flag_name) continue;
+
+            if(scratch.plan_kind[i] == plan_t::flag_value) {
+                int slot = scratch.plan_slot[i];
+                args[slot] = convert_counted(cur->args[slot].type, names[i], scratch);
+                continue;
+            }
+
+            if(scratch.plan_kind[i] == plan_t::flag_equals) {
+                int slot = scratch.plan_slot[i];
+                std::string_view val = trim_flag(names[i]);
+                val.remove_prefix(val.find('=') + 1);
+                args[slot] = convert_counted(cur->args[slot].type, val, scratch);
+                continue;
+            }
+
+            while(pos < fixed && scratch.is_claimed(pos)) {
+                pos++;
+            }
+            if(pos >= fixed) {
+                if(!cur->variadic) {
+                    continue; // more positionals than slots; reported below as unconverted tokens
+                }
+
+                int slot = tail_count == 0 ? fixed : static_cast<int>(args.size());
+                value_t v = convert_counted(cur->args[fixed].type, names[i], scratch);
+                if(tail_count == 0) {
+                    args[fixed] = std::move(v);
+                }
+                else {
+                    args.push_back(std::move(v));
+                }
+
+                scratch.plan_slot[i] = slot;
+                scratch.token_slot[i] = slot;
+                tail_count++;
+                continue;
+            }
+
+            args[pos] = convert_counted(cur->args[pos].type, names[i], scratch);
+            scratch.plan_slot[i] = pos;
+            scratch.token_slot[i] = pos;
+            scratch.claim(pos);
+        }
+
+        // fill in default values and check that every slot was bound
+        for(int i = 0; i < fixed && i < cur->args.size(); i++) {
+            if(!args[i].has_value() && cur->args[i].def.has_value()) {
+                args[i] = cur->args[i].def;
+                scratch.plan_defaults.push_back({i, cur->args[i].def});
+            }
+        }
+
+        for(int i = 0; i < args.size(); i++) {
+            if(!args[i].has_value() && !(cur->variadic && i == fixed && tail_count == 0)) {
+                suc = false;
+            }
+        }
+
+        for(int i = 0; i < names.size(); i++) {
+            successes[i] = scratch.token_slot[i] != -1 && args[scratch.token_slot[i]].has_value();
+        }
+
+        // check arguments
+        if(!suc) {
+            if(quiet) {
+                scratch.fail = 2;
+                return nullptr;
+            }
+
+            std::vector<std::string> input(names.begin(), names.end());
+
+            if(cur->invalid_args_func) {
+                std::vector<std::string> cur_names = cur->get_names();
+                std::vector<std::string> path = materialize_path(prog, scratch.prefix, scratch.prefix.size());
+                cur->invalid_args_func(cur_names, successes, path, input);
+            }
+            else if(!cur->invalid_args_msg.empty()) {
+                emit_message(cur->invalid_args_msg);
+            }
+            else if(!invalid_args_msg.empty()) {
+                emit_message(invalid_args_msg);
+            }
+            else {
+                std::vector<std::string> cur_names = cur->get_names();
+                std::vector<std::string> path = materialize_path(prog, scratch.prefix, scratch.prefix.size());
+                if(invalid_args_func) {
+                    invalid_args_func(cur_names, successes, path, input);
+                }
+                else {
+                    default_invalid_args(cur_names, successes, path, input);
+                }
+            }
+            return nullptr;
+        }
+
+        // remember the successful resolution for this shape
+        if(frozen && scratch.plan_usable) {
+            if(scratch.plans.size() >= plan_t::cache_budget) {
+                scratch.plans.clear();
+            }
+
+            plan_t& plan = scratch.plans[plan_key(cur_idx)];
+            plan.kind = scratch.plan_kind;
+            plan.slot = scratch.plan_slot;
+            plan.sym = scratch.plan_sym;
+            plan.presets = scratch.plan_presets;
+            plan.defaults = scratch.plan_defaults;
+        }
+
+#ifndef DISPATCHER_NO_STATS
+        if(node_stats_t* st = stats_of(cur_idx)) {
+            record_parse(st, t0, t1, scratch);
+        }
+#endif
+
+        return cur;
+    }
+
+public:
+    Dispatcher() {
+        new_node(); // root
+    }
+
+    template<typename ...Args>
+    void add_command(const std::vector<std::string>& path, void (*func)(Args...)) {
+        std::function<void(Args...)> wrapped = func;
+        static constexpr std::size_t N = sizeof...(Args);
+        add_command_impl<N, Args...>(path, std::move(wrapped));
+    }
+
+    /// Compile-time registration: the target function is a template argument, e.g.
+    /// `d.add_command<&my_func>({"path"})`, so the generated execute thunk calls it directly
+    /// with no type erasure in between.
+    template<auto Func>
+    void add_command(const std::vector<std::string>& path) {
+        add_command_static_impl<Func>(path, Func);
+    }
+
+    /// Registration handle bound to one resolved node: d.command(path) walks the tree a single
+    /// time (creating missing segments, like add_command) and every chained call configures the
+    /// node directly, so a command with several flags, defaults, and aliases costs one
+    /// traversal instead of one per attribute:
+    ///
+    ///     d.command({"net", "probe"}).handler(probe).default_(0, 5).flag(1, "v", true);
+    class command_t {
+    public:
+        template<typename ...Args>
+        command_t& handler(void (*func)(Args...)) {
+            std::function<void(Args...)> wrapped = func;
+            install_handler<sizeof...(Args), Args...>(d.node_mut(node), std::move(wrapped));
+            return *this;
+        }
+
+        command_t& alias(std::string_view alias) {
+            if(parent == -1) {
+                throw std::logic_error("Failed to alias " + std::string(alias) + " on the root node.");
+            }
+
+            if(!d.node_mut(parent).add_alias(sym, d.syms_mut().intern(alias))) {
+                throw std::logic_error("Failed to alias " + std::string(alias) + " on " + d.syms().name(sym) + '.');
             }
 
-            return {-1, std::any()};
+            return *this;
         }
 
-        void add_default(int idx, std::any& def) {
-            args[idx].def = def;
+        command_t& flag(int idx, std::string_view name) {
+            check(idx);
+            d.node_mut(node).add_flag(d.syms_mut().intern(name), idx, value_t());
+            return *this;
         }
 
-        bool add_alias(std::string& name, std::string& alias) {
-            for(int i = 0; i < next.size(); i++) {
-                std::vector<std::string>& names = next[i].first;
-    
-                for(std::string& s : names) {
-                    if(s == name) {
-                        names.push_back(alias);
-                        return true;
-                    }
-                }
-            }
-
-            return false;
+        template<typename T>
+        command_t& flag(int idx, std::string_view name, T value) {
+            check(idx);
+            d.node_mut(node).add_flag(d.syms_mut().intern(name), idx, value_t::box(std::move(value)));
+            return *this;
         }
 
-        void set_invalid_args_message(std::string& msg) {
-            invalid_args_msg = msg;
+        template<typename T>
+        command_t& default_(int idx, T def) {
+            check(idx);
+            d.node_mut(node).add_default(idx, value_t::box(std::move(def)));
+            return *this;
         }
 
-        void set_invalid_command_message(std::string& msg) {
-            invalid_command_msg = msg;
+        command_t& arg_name(int idx, std::string name) {
+            check(idx);
+            d.node_mut(node).args[idx].name = std::move(name);
+            return *this;
         }
-    };
 
-    void destructor_helper(dispatch_node_t* cur) {
-        for(auto p : cur->next) {
-            destructor_helper(p.second);
+        command_t& invalid_args_message(std::string msg) {
+            d.node_mut(node).invalid_args_msg = std::move(msg);
+            return *this;
         }
 
-        delete(cur);
-    }
+        command_t& invalid_command_message(std::string msg) {
+            d.node_mut(node).invalid_command_msg = std::move(msg);
+            return *this;
+        }
 
-    template<int N, typename ...Args>
-    std::tuple<Args...> convert_args(std::vector<std::any>& args) {
-        return convert_args_impl<Args...>(args, std::make_index_sequence<N>{});
-    }
+    private:
+        friend class Dispatcher;
 
-    template<typename ...Args, std::size_t ...I>
-    std::tuple<Args...> convert_args_impl(std::vector<std::any>& args, std::index_sequence<I...> seq) {
-        return std::make_tuple(std::any_cast<Args>(args[I])...);
-    }
+        command_t(Dispatcher& d, int node, int parent, int sym) : d(d), node(node), parent(parent), sym(sym) { }
 
-    dispatch_node_t* root;
+        void check(int idx) {
+            if(idx >= d.node_at(node).num_args) {
+                index_failed(idx, d.node_at(node).num_args);
+            }
+        }
 
-    std::unordered_map<std::type_index, std::function<std::any(std::string)>> conversions {
-        {typeid(int), [](std::string s) { return stoi(s); }},
-        {typeid(float), [](std::string s) { return stof(s); }},
-        {typeid(double), [](std::string s) { return stod(s); }},
-        {typeid(std::string), [](std::string s) { return s; }}
+        Dispatcher& d;
+        int node; ///< Arena index of the configured node; indices stay stable across arena growth.
+        int parent; ///< Arena index of the parent, for alias registration; -1 for the root.
+        int sym; ///< Symbol of the node's own name under its parent.
     };
 
-    std::any convert(std::type_index type, std::string s) {
-        if(conversions.find(type) != conversions.end()) {
-            try {
-                return conversions[type](s);
+    command_t command(const std::vector<std::string>& path) {
+        assert_mutable();
+        int parent = -1, cur = 0, sym = -1;
+
+        for(int i = 0; i < path.size(); i++) {
+            int next = find_child(cur, path[i]);
+
+            if(next == -1 && cur == 0 && materialize_lazy(path[i])) {
+                next = find_child(cur, path[i]);
             }
-            catch(...) {
-                return std::any();
+
+            if(next == -1) {
+                next = new_node();
+                node_mut(cur).add_next(syms_mut().intern(path[i]), next);
             }
+
+            parent = cur;
+            sym = syms().find(path[i]);
+            cur = next;
         }
-        throw std::logic_error("Missing proper conversion for argument " + s + '.');
+
+        return command_t(*this, cur, parent, sym);
     }
 
-    std::string invalid_args_msg;
+    /// Defers registration of everything under a top-level path segment. The factory runs the
+    /// first time a traversal descends into that segment (and may use the full registration
+    /// API), so startup cost scales with the subtrees an invocation actually touches.
+    void add_lazy_commands(std::string name, std::function<void(Dispatcher&)> factory) {
+        assert_mutable();
+        lazy_factories[std::move(name)] = std::move(factory);
+    }
 
-    std::string invalid_command_msg;
+    /// Cheap copy with structural sharing: the clone shares this dispatcher's node arena and
+    /// symbol table, and only the nodes it (or this dispatcher) modifies afterwards are copied
+    /// into that side's private overlay — so hundreds of lightly-customized variants cost
+    /// barely more than one tree.
+    Dispatcher clone() const {
+        return *this;
+    }
 
-    static std::string path_to_str(std::vector<std::string>& path, std::string delim = " ") {
-        std::string path_str = path[0];
-        for(int i = 1; i < path.size(); i++) {
-            path_str.append(delim + path[i]);
+    /// Finalizes the tree: pending lazy subtrees are materialized and registration is closed.
+    /// Afterwards dispatch never mutates shared state, so execute_command / execute_line are
+    /// safe to call concurrently from many threads, each on its own thread-local scratch.
+    void freeze() {
+        if(frozen) {
+            return; // repeat callers (async, batch) must not rebuild tables under live readers
         }
 
-        return path_str;
-    }
+        while(!lazy_factories.empty()) {
+            materialize_lazy(lazy_factories.begin()->first);
+        }
 
-    static void index_failed(int idx, int num_args) {
-        throw std::logic_error("Provided index " + std::to_string(idx) + " too large for " + std::to_string(num_args) + " arguments.");
-    }
+        // re-emit the tree's child edges into the dense finalized layout, collapsing chains of
+        // pass-through nodes (one child, no handler, no flags, no aliases) into single edges.
+        // Completion tables are built into the same side structure, so freeze stays read-only
+        // against nodes a clone may still share.
+        auto table = std::make_shared<frozen_edges_t>();
+        table->starts.reserve(node_count + 1);
+        table->starts.push_back(0);
+        table->completions.resize(node_count);
+        for(int n = 0; n < node_count; n++) {
+            std::uint64_t bloom = 0;
+            std::vector<std::string>& comp = table->completions[n];
+            for(auto& p : node_at(n).next) {
+                for(int sym : p.first) {
+                    bloom |= bloom_bits(sym);
+                    comp.push_back(syms().name(sym));
+                    edge_t e = {sym, p.second, p.second, static_cast<int>(table->tails.size()), 0};
+                    for(dispatch_node_t* c = &node_at(e.node);
+                        !c->execute && c->flag_index.empty() && c->next.size() == 1 && c->next[0].first.size() == 1;
+                        c = &node_at(e.node)) {
+                        table->tails.push_back(c->next[0].first[0]);
+                        e.node = c->next[0].second;
+                    }
 
-    dispatch_node_t* traverse_entire(std::vector<std::string>& path) {
-        dispatch_node_t* cur = root;
-        for(std::string& name : path) {
-            cur = cur->find_next(name);
+                    e.tail_end = static_cast<int>(table->tails.size());
+                    table->edges.push_back(e);
+                }
+            }
 
-            if(!cur) {
-                throw std::logic_error("Failed to find path: " + path_to_str(path));
+            for(auto& p : node_at(n).flag_index) {
+                comp.push_back("-" + syms().name(p.first));
             }
+            std::sort(comp.begin(), comp.end());
+
+            std::sort(table->edges.begin() + table->starts.back(), table->edges.end(),
+                [](const edge_t& a, const edge_t& b) { return a.sym < b.sym; });
+            table->starts.push_back(static_cast<int>(table->edges.size()));
+            table->blooms.push_back(bloom);
         }
+        edge_table = std::move(table);
 
-        return cur;
+        frozen = true;
     }
 
-    std::pair<int, dispatch_node_t*> traverse_until(std::vector<std::string>& path) {
-        dispatch_node_t* cur = root;
-        int idx;
-        
-        for(idx = 0; idx < path.size(); idx++) {
-            if(path[idx][0] == '-') {
-                return {idx, cur};
-            }
+    /// Completion candidates for a partially typed line: tokens before the cursor select the
+    /// node, the trailing partial token (if the line does not end in whitespace) filters the
+    /// candidates by prefix. On a frozen tree this is a binary search over the node's
+    /// precomputed sorted table — no traversal-wide allocation, suitable for per-keystroke
+    /// queries; unfrozen trees fall back to collecting candidates on the fly. The returned
+    /// views live in thread-local scratch and stay valid until the next call on this thread.
+    const std::vector<std::string_view>& complete(std::string_view line) {
+        scratch_t& scratch = tls_scratch();
+        tokenize(line, scratch.names);
+
+        std::string_view prefix = "";
+        std::size_t path_len = scratch.names.size();
+        if(!scratch.names.empty() && line.back() != ' ' && line.back() != '\t') {
+            prefix = scratch.names.back();
+            path_len--;
+        }
+
+        scratch.completion_out.clear();
 
-            dispatch_node_t* next = cur->find_next(path[idx]);
+        int cur = 0;
+        for(std::size_t i = 0; i < path_len; i++) {
+            int next = find_child(cur, scratch.names[i]);
 
-            if(!next) {
-                return {idx, cur};
+            if(next == -1 && cur == 0 && materialize_lazy(scratch.names[i])) {
+                next = find_child(cur, scratch.names[i]);
+            }
+
+            if(next == -1) {
+                return scratch.completion_out;
             }
 
             cur = next;
         }
 
-        return {idx, cur};
-    }
-
-    dispatch_node_t* traverse_drill(std::vector<std::string>& path) {
-        dispatch_node_t* cur = root;
-        for(int i = 0; i < path.size(); i++) {
-            dispatch_node_t* next = cur->find_next(path[i]);
+        if(frozen) {
+            const std::vector<std::string>& table = edge_table->completions[cur];
+            auto it = std::lower_bound(table.begin(), table.end(), prefix,
+                [](const std::string& a, std::string_view b) { return std::string_view(a) < b; });
 
-            if(!next) {
-                next = new dispatch_node_t();
-                cur->next.push_back({{path[i]}, next});
+            for(; it != table.end() && it->compare(0, prefix.size(), prefix) == 0; ++it) {
+                scratch.completion_out.push_back(*it);
             }
 
-            cur = next;
+            return scratch.completion_out;
         }
 
-        return cur;
-    }
+        // mutable tree: candidates can change between calls, so gather and sort them here
+        scratch.completion_store.clear();
+        dispatch_node_t& node = node_at(cur);
+        for(auto& p : node.next) {
+            for(int sym : p.first) {
+                scratch.completion_store.push_back(syms().name(sym));
+            }
+        }
+        for(auto& p : node.flag_index) {
+            scratch.completion_store.push_back("-" + syms().name(p.first));
+        }
+        if(cur == 0) {
+            for(auto& p : lazy_factories) {
+                scratch.completion_store.push_back(p.first);
+            }
+        }
 
-    template<int N, typename ...Args>
-    void add_command_impl(std::vector<std::string> path, std::function<void(Args...)> func) {
-        dispatch_node_t* cur = traverse_drill(path);
+        std::sort(scratch.completion_store.begin(), scratch.completion_store.end());
 
-        cur->execute = [func, this](std::vector<std::any> args) {
-            std::apply(func, convert_args<N, Args...>(args));
-        };
-        cur->num_args = N;
+        for(std::string& name : scratch.completion_store) {
+            if(name.compare(0, prefix.size(), prefix) == 0) {
+                scratch.completion_out.push_back(name);
+            }
+        }
 
-        cur->args = { arg_t(Args{ })... };
+        return scratch.completion_out;
     }
 
-    std::string trim_flag(std::string s) {
-        for(int i = 0; i < s.size(); i++) {
-            if(s[i] != '-') {
-                s = s.substr(i, s.size() - i);
-                return s;
-            }
+    void execute_command(int argc, const char* argv[]) {
+        // argv is viewed in place, never copied
+        scratch_t& scratch = tls_scratch();
+
+        scratch.names.clear();
+        for(int i = 1; i < argc; i++) {
+            scratch.names.push_back(std::string_view(argv[i]));
         }
 
-        return s;
+        dispatch(argv[0], scratch.names);
     }
 
-    static int levenshtein(std::string& s1, std::string& s2) {
-        int N = s1.size(), M = s2.size();
-        int dp[N + 1][M + 1];
+    void execute_command(int argc, char* argv[]) {
+        execute_command(argc, const_cast<const char**>(argv));
+    }
 
-        for(int i = M; i >= 0; i--) {
-            dp[N][i] = M - i;
-        }
-        for(int i = N; i >= 0; i--) {
-            dp[i][M] = N - i;
-        }
+    /// Executes a single whitespace-separated command line against the already-built tree. The
+    /// line is tokenized in place, so one call does no per-token copies of the input.
+    void execute_line(std::string_view line) {
+        scratch_t& scratch = tls_scratch();
 
-        for(int i = N - 1; i >= 0; i--) {
-            for(int j = M - 1; j >= 0; j--) {
-                dp[i][j] = 1e9;
-                dp[i][j] = std::min(dp[i][j], dp[i + 1][j + 1] + (s1[i] != s2[j])); // substitution
-                dp[i][j] = std::min(dp[i][j], 1 + dp[i][j + 1]); // deletion
-                dp[i][j] = std::min(dp[i][j], 1 + dp[i + 1][j]); // insertion
-            }
-        }
+        tokenize(line, scratch.names);
 
-        return dp[0][0];
+        if(!scratch.names.empty()) {
+            dispatch("", scratch.names);
+        }
     }
 
-    static std::vector<std::string> find_close(std::vector<std::string>& names, std::string& s, int threshold) {
-        std::vector<std::string> res;
-        for(std::string& name : names) {
-            if(levenshtein(name, s) <= threshold) {
-                res.push_back(name);
-            }
+    /// Outcome of a quiet dispatch; see try_execute_line().
+    enum class exec_status {
+        ok,
+        no_match, ///< Traversal did not end on an executable node.
+        invalid_args ///< The command matched but binding or conversion failed.
+    };
+
+    /// Quiet execute mode: parses and runs the line like execute_line(), but a failed
+    /// resolution returns a structured status instead of going through the suggestion and
+    /// error machinery — no sibling collection, no edit-distance pass, no output. Intended
+    /// for callers that probe many candidate lines and expect misses to be the common,
+    /// cheap case.
+    exec_status try_execute_line(std::string_view line) {
+        scratch_t& scratch = tls_scratch();
+
+        tokenize(line, scratch.names);
+        if(scratch.names.empty()) {
+            return exec_status::no_match;
         }
 
-        return res;
+        scratch.fail = 0;
+        dispatch_node_t* cur = parse_invocation("", scratch.names, scratch, true);
+        if(!cur) {
+            return scratch.fail == 2 ? exec_status::invalid_args : exec_status::no_match;
+        }
+
+        execute_parsed(cur, scratch);
+        return exec_status::ok;
     }
 
-    InvalidCommandFunc invalid_command_func = [](std::vector<std::string>& path, std::vector<std::string>& next, std::string& name) {
-        std::vector<std::string> closest = find_close(next, name, 2);
+    /// Reads commands from the stream one line at a time until EOF, reusing the tree and the
+    /// per-invocation scratch buffers across iterations. Intended for batch scripts and
+    /// interactive shells that would otherwise fork+exec the binary per command.
+    void run_shell(std::istream& in) {
+        scratch_t& scratch = tls_scratch();
 
-        std::cout << "Unknown command: " << path_to_str(path) << " \033[31m" << name << "\033[30m\n\n";
+        while(std::getline(in, scratch.line)) {
+            execute_line(scratch.line);
+        }
+    }
 
-        if(!closest.empty()) {
-            if(closest.size() == 1) {
-                std::cout << "The most similar command is:\n";
-            }
-            else {
-                std::cout << "Similar commands are:\n";
+#if defined(__unix__) || defined(__APPLE__)
+    /// Streams newline-separated commands from a file descriptor: reads large chunks, splits
+    /// lines in place, and dispatches each through the zero-copy tokenizer, so a piped producer
+    /// costs one read(2) per buffer rather than one process or allocation per line.
+    /// Backpressure falls out of the blocking read. Partial lines are carried across reads.
+    void run_stream(int fd, std::size_t buf_size = 1 << 16) {
+        std::string buf(buf_size, '\0');
+        std::size_t filled = 0;
+
+        while(true) {
+            if(filled == buf.size()) {
+                buf.resize(buf.size() * 2); // line longer than the buffer
             }
 
-            for(std::string& close : closest) {
-                std::cout << '\t' << close << '\n';
-            }
-            std::cout << '\n';
-        }
-        else {
-            std::cout << "Possible commands are:\n";
-            for(std::string& name : next) {
-                std::cout << '\t' << name << '\n';
-            }
-            std::cout << '\n';
-        }
-    };
-    
-    InvalidArgsFunc invalid_args_func = [](std::vector<std::string>& names, std::vector<bool>& converted, std::vector<std::string>& path, std::vector<std::string>& input) {
-        std::cout << "Invalid arguments: " << path_to_str(path);
-        bool first = true;
-        for(int i = 0; i < converted.size(); i++) {
-            if(!converted[i]) {
-                std::cout << " \033[31m" << input[i] << "\033[30m";
-            }
-            else {
-                std::cout << ' ' << input[i];
+            ssize_t n = ::read(fd, buf.data() + filled, buf.size() - filled);
+            if(n < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                throw std::logic_error("Failed to read from stream.");
             }
-        }
-        std::cout << '\n';
+            filled += n;
 
-        std::cout << "\nExpected: " << path_to_str(path) << ' ';
+            std::size_t start = 0;
+            while(start < filled) {
+                const char* nl = static_cast<const char*>(std::memchr(buf.data() + start, '\n', filled - start));
+                if(!nl) {
+                    break;
+                }
 
-        for(int i = 0; i < names.size(); i++) {
-            if(names[i].empty()) {
-                std::cout << "[arg" << i + 1 << ']';
+                execute_line(std::string_view(buf.data() + start, nl - (buf.data() + start)));
+                start = (nl - buf.data()) + 1;
             }
-            else {
-                std::cout << '[' << names[i] << ']';
+
+            if(start > 0) {
+                std::memmove(buf.data(), buf.data() + start, filled - start);
+                filled -= start;
             }
 
-            if(i != names.size() - 1) {
-                std::cout << ' ';
+            if(n == 0) {
+                if(filled > 0) {
+                    execute_line(std::string_view(buf.data(), filled));
+                }
+                break;
             }
         }
-        std::cout << '\n' << '\n';
-    };
+    }
+#endif
 
-public:
-    using InvalidArgsFunc = InvalidArgsFunc;
-    using InvalidCommandFunc = InvalidCommandFunc;
+    enum class batch_policy {
+        ordered, ///< Parse in parallel, then execute serially in input order.
+        parallel ///< Parse and execute each line entirely on the worker that claims it.
+    };
 
-    Dispatcher() {
-        root = new dispatch_node_t();
+    /// Executes many command lines, parsing them in parallel across worker threads. Freezes the
+    /// dispatcher first, since parsing is only read-only against a finalized tree. With the
+    /// ordered policy, handlers run serially in input order after all parsing completes; error
+    /// reports for unparseable lines are emitted by the workers as they are found.
+    /// Starts (or grows to) num_threads workers for the async execution mode; called lazily
+    /// with the hardware thread count if an async dispatch arrives first.
+    void async_workers(int num_threads) {
+        ensure_workers(num_threads);
     }
 
-    ~Dispatcher() {
-        destructor_helper(root);
-    }
+    /// Parses and binds the line inline — errors are reported synchronously, exactly like
+    /// execute_line — then moves the converted argument pack onto the work queue and returns,
+    /// so a slow handler never stalls the parser. The future completes when the handler ran
+    /// (or carries its exception). First use freezes the tree, matching execute_batch.
+    std::future<void> execute_line_async(std::string_view line) {
+        freeze();
+        if(!async_state || async_state->workers.empty()) {
+            int n = std::thread::hardware_concurrency();
+            ensure_workers(n > 0 ? n : 1);
+        }
 
-    template<typename ...Args>
-    void add_command(const std::vector<std::string> path, void (*func)(Args...)) {
-        std::function<void(Args...)> wrapped = func;
-        static constexpr std::size_t N = sizeof...(Args);
-        add_command_impl<N, Args...>(path, wrapped);
+        scratch_t& scratch = tls_scratch();
+        tokenize(line, scratch.names);
+
+        if(scratch.names.empty()) {
+            return enqueue_parsed(nullptr, scratch);
+        }
+
+        return enqueue_parsed(parse_invocation("", scratch.names, scratch), scratch);
     }
 
-    void execute_command(int argc, const char* argv[]) {
-        // get proper dispatch node
-        std::vector<std::string> names(argc - 1);
+    std::future<void> execute_command_async(int argc, const char* argv[]) {
+        freeze();
+        if(!async_state || async_state->workers.empty()) {
+            int n = std::thread::hardware_concurrency();
+            ensure_workers(n > 0 ? n : 1);
+        }
+
+        scratch_t& scratch = tls_scratch();
+        scratch.names.clear();
         for(int i = 1; i < argc; i++) {
-            names[i - 1] = std::string(argv[i]);
+            scratch.names.push_back(std::string_view(argv[i]));
         }
 
-        auto [idx, cur] = traverse_until(names);
+        return enqueue_parsed(parse_invocation(argv[0], scratch.names, scratch), scratch);
+    }
 
-        // check if node can execute
-        if(!(cur->execute)) {
-            if(cur->invalid_command_func) {
-                std::vector<std::string> path = std::vector<std::string>(argv, argv + idx + 1);
-                std::vector<std::string> next = cur->get_next();
+    /// Blocks until every queued async invocation has finished.
+    void wait() {
+        if(!async_state) {
+            return;
+        }
 
-                std::string name = "";
-                if(idx < names.size()) {
-                    name = names[idx];
-                }
+        std::unique_lock<std::mutex> lock(async_state->m);
+        async_state->drained.wait(lock, [&] { return async_state->in_flight == 0; });
+    }
 
-                cur->invalid_command_func(path, next, name);
-            }
-            else if(!cur->invalid_command_msg.empty()) {
-                std::cout << cur->invalid_command_msg << '\n';
-            }
-            else if(!invalid_command_msg.empty()) {
-                std::cout << invalid_command_msg << '\n';
+    void execute_batch(const std::vector<std::string>& lines, batch_policy policy = batch_policy::ordered, int num_threads = 0) {
+        freeze();
+
+        if(num_threads <= 0) {
+            num_threads = std::thread::hardware_concurrency();
+            if(num_threads <= 0) {
+                num_threads = 1;
             }
-            else {
-                std::vector<std::string> path = std::vector<std::string>(argv, argv + idx + 1);
-                std::vector<std::string> next = cur->get_next();
+        }
 
-                std::string name = "";
-                if(idx < names.size()) {
-                    name = names[idx];
-                }
+        std::atomic<std::size_t> head { 0 };
 
-                invalid_command_func(path, next, name);
+        if(policy == batch_policy::parallel) {
+            std::vector<std::thread> workers;
+            for(int t = 0; t < num_threads; t++) {
+                workers.emplace_back([&]() {
+                    for(std::size_t i = head++; i < lines.size(); i = head++) {
+                        execute_line(lines[i]);
+                    }
+                });
+            }
+            for(std::thread& w : workers) {
+                w.join();
             }
             return;
         }
-        
-        names = std::vector<std::string>(names.begin() + idx, names.end());
 
-        std::vector<std::any> args(cur->num_args);
-        std::vector<bool> converted(cur->num_args);
-        std::vector<bool> flags(args.size());
-        std::vector<std::vector<int>> attempted(cur->num_args);
-        bool suc = true;
+        struct parsed_t {
+            dispatch_node_t* node = nullptr;
+            int node_idx = -1;
+            std::vector<value_t> args;
+        };
+        std::vector<parsed_t> parsed(lines.size());
 
-        // find and update flags
-        for(int i = 0; i < names.size(); i++) {
-            std::string trimmed = trim_flag(names[i]);
-            if(trimmed.size() == names[i].size()) continue;
+        std::vector<std::thread> workers;
+        for(int t = 0; t < num_threads; t++) {
+            workers.emplace_back([&]() {
+                scratch_t& scratch = tls_scratch();
 
-            auto [idx, value] = cur->find_flag(trimmed);
+                for(std::size_t i = head++; i < lines.size(); i = head++) {
+                    tokenize(lines[i], scratch.names);
+                    if(scratch.names.empty()) {
+                        continue;
+                    }
+
+                    parsed[i].node = parse_invocation("", scratch.names, scratch);
+                    if(parsed[i].node) {
+                        parsed[i].node_idx = scratch.node_idx;
+                        parsed[i].args = scratch.args;
+                    }
+                }
+            });
+        }
+        for(std::thread& w : workers) {
+            w.join();
+        }
 
-            if(idx == -1) {
+        for(parsed_t& p : parsed) {
+            if(!p.node) {
                 continue;
             }
 
-            attempted[idx].push_back(i);
+#ifndef DISPATCHER_NO_STATS
+            if(node_stats_t* st = stats_of(p.node_idx)) {
+                std::uint64_t t = now_ns();
+                p.node->execute(p.args);
+                std::uint64_t ns = now_ns() - t;
 
-            flags[i] = true;
-            if(!value.has_value()) {
-                i++;
+                st->invocations.fetch_add(1, std::memory_order_relaxed);
+                st->execute_ns.fetch_add(ns, std::memory_order_relaxed);
+                st->execute_hist[hist_bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+#endif
+            p.node->execute(p.args);
+        }
+    }
 
-                if(i >= names.size()) {
-                    continue;
-                }
+    /// Writes the tree (structure, aliases, arg names, flags, built-in defaults, messages) in a
+    /// flat binary format. Pending lazy subtrees are materialized first so the file is complete.
+    void save(const std::string& file) {
+        while(!lazy_factories.empty()) {
+            materialize_lazy(lazy_factories.begin()->first);
+        }
 
-                flags[i] = true;
-                
-                args[idx] = convert(cur->args[idx].type, names[i]);
-                attempted[idx].push_back(i);
-            }
-            else {
-                args[idx] = value;
-            }
+        std::ofstream out(file, std::ios::binary);
+        if(!out) {
+            throw std::logic_error("Failed to open " + file + " for writing.");
         }
 
-        // populate regular arguments
-        for(int i = 0, idx = 0; i < names.size(); i++) {
-            if(flags[i]) continue;
+        out.write("DSPT", 4);
+        write_u32(out, 1); // version
+        write_u32(out, node_count);
 
-            while(idx < args.size() && !attempted[idx].empty()) {
-                idx++;
+        for(int n = 0; n < node_count; n++) {
+            dispatch_node_t& node = node_at(n);
+
+            write_u32(out, node.next.size());
+            for(auto& child : node.next) {
+                write_u32(out, child.first.size());
+                for(int name : child.first) {
+                    write_str(out, syms().name(name));
+                }
+                write_u32(out, child.second);
             }
 
-            args[idx] = convert(cur->args[idx].type, names[i]);
-            attempted[idx].push_back(i);
-        }
+            write_u32(out, node.args.size());
+            for(arg_t& arg : node.args) {
+                write_str(out, arg.name);
+                write_value(out, arg.def);
 
-        // fill in default values
-        for(int i = 0; i < args.size() && i < cur->args.size(); i++) {
-            if(!args[i].has_value() && cur->args[i].def.has_value()) {
-                args[i] = cur->args[i].def;
-            }
-        }
-        
-        std::vector<bool> successes(names.size(), false);
-        for(int i = 0; i < args.size(); i++) {
-            if(args[i].has_value()) {
-                for(int j : attempted[i]) {
-                    successes[j] = true;
+                write_u32(out, arg.flags.size());
+                for(auto& flag : arg.flags) {
+                    write_str(out, syms().name(flag.first));
+                    write_value(out, flag.second);
                 }
             }
-            else {
-                suc = false;
-            }
+
+            write_str(out, node.invalid_command_msg);
+            write_str(out, node.invalid_args_msg);
         }
+    }
 
-        // check arguments
-        if(!suc) {
-            if(cur->invalid_args_func) {
-                std::vector<std::string> cur_names = cur->get_names();
-                std::vector<std::string> path = std::vector<std::string>(argv, argv + idx + 1);
-                cur->invalid_args_func(cur_names, successes, path, names);
-            }
-            else if(!cur->invalid_args_msg.empty()) {
-                std::cout << cur->invalid_args_msg << '\n';
-            }
-            else if(!invalid_args_msg.empty()) {
-                std::cout << invalid_args_msg << '\n';
-            }
-            else {
-                std::vector<std::string> cur_names = cur->get_names();
-                std::vector<std::string> path = std::vector<std::string>(argv, argv + idx + 1);
-                invalid_args_func(cur_names, successes, path, names);
-            }
-            return;
+    /// Rebuilds the tree from a saved file in a single pass, memory-mapping it where available
+    /// so startup does no read-ahead or parse work beyond the nodes themselves. Handlers are
+    /// not stored in the file; attach them afterwards with bind_command, which preserves the
+    /// loaded flags and defaults.
+    void load(const std::string& file) {
+        assert_mutable();
+#if defined(__unix__) || defined(__APPLE__)
+        int fd = open(file.c_str(), O_RDONLY);
+        if(fd == -1) {
+            throw std::logic_error("Failed to open " + file + " for reading.");
+        }
+
+        struct stat st;
+        if(fstat(fd, &st) == -1) {
+            close(fd);
+            throw std::logic_error("Failed to stat " + file + '.');
         }
 
-        // execute method
-        cur->execute(args);
+        void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if(data == MAP_FAILED) {
+            throw std::logic_error("Failed to map " + file + '.');
+        }
+
+        tree_reader_t in { static_cast<const char*>(data), static_cast<std::size_t>(st.st_size) };
+        try {
+            load_from(in);
+        }
+        catch(...) {
+            munmap(data, st.st_size);
+            throw;
+        }
+        munmap(data, st.st_size);
+#else
+        std::ifstream stream(file, std::ios::binary);
+        if(!stream) {
+            throw std::logic_error("Failed to open " + file + " for reading.");
+        }
+
+        std::string buf((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+        tree_reader_t in { buf.data(), buf.size() };
+        load_from(in);
+#endif
     }
 
-    void execute_command(int argc, char* argv[]) {
-        execute_command(argc, const_cast<const char**>(argv));
+    /// Attaches a handler to a node restored by load without clobbering its loaded flag and
+    /// default metadata; only the argument types are (re)established from the signature.
+    template<typename ...Args>
+    void bind_command(const std::vector<std::string>& path, void (*func)(Args...)) {
+        static constexpr std::size_t N = sizeof...(Args);
+
+        dispatch_node_t* cur = traverse_drill(path);
+
+        std::function<void(Args...)> wrapped = func;
+        cur->execute = make_thunk<N, Args...>(std::move(wrapped));
+        cur->num_args = N;
+
+        if(cur->args.size() != N) {
+            cur->args = { arg_t(Args{ })... };
+        }
+        else if constexpr(N > 0) {
+            std::type_index types[] = { std::type_index(typeid(Args))... };
+            for(int i = 0; i < N; i++) {
+                cur->args[i].type = types[i];
+            }
+        }
+
+        using last_t = typename tail_of<Args...>::type;
+        if constexpr(vector_tail<last_t>::value) {
+            cur->variadic = true;
+            cur->args[N - 1].type = std::type_index(typeid(typename vector_tail<last_t>::elem_t));
+        }
     }
 
     template<typename T>
     void add_conversion(std::function<T(std::string)> convert) {
-        conversions[typeid(T)] = [convert](std::string s) {
-            return std::any(convert(s));
+        conversions[typeid(T)] = [convert](std::string_view s) {
+            return value_t::box(convert(std::string(s)));
         };
     }
 
-    void add_alias(std::vector<std::string> path, std::string alias) {
-        std::string orig = path[path.size() - 1];
-        path.pop_back();
+    /// Opts T's conversion into per-thread memoization: repeated tokens cost a lookup instead
+    /// of a re-parse, which pays off for expensive add_conversion parsers fed recurring
+    /// literals in batch or stream mode. Each thread keeps up to capacity entries per type and
+    /// sweeps the table wholesale when it overflows. Only worthwhile for conversions costlier
+    /// than a map probe — the from_chars builtins are better off unmemoized.
+    template<typename T>
+    void cache_conversions(std::size_t capacity = 256) {
+        cached_types[typeid(T)] = capacity;
+    }
 
-        dispatch_node_t* cur = traverse_entire(path);
+    void add_alias(const std::vector<std::string>& path, std::string_view alias) {
+        const std::string& orig = path[path.size() - 1];
 
-        if(!cur->add_alias(path[path.size() - 1], alias)) {
-            throw std::logic_error("Failed to alias " + alias + "on " + path[path.size() - 1] + '.');
+        dispatch_node_t* cur = &node_mut(traverse_exact(path, path.size() - 1));
+
+        int orig_sym = syms().find(orig);
+        if(orig_sym == -1 || !cur->add_alias(orig_sym, syms_mut().intern(alias))) {
+            throw std::logic_error("Failed to alias " + std::string(alias) + " on " + orig + '.');
         }
     }
 
-    void add_positional_flag(std::vector<std::string> path, int idx, std::string flag) {
+    void add_positional_flag(const std::vector<std::string>& path, int idx, std::string_view flag) {
         dispatch_node_t* cur = traverse_entire(path);
 
         if(idx >= cur->num_args) {
             index_failed(idx, cur->num_args);
         }
 
-        cur->args[idx].flags[flag];
+        cur->add_flag(syms_mut().intern(flag), idx, value_t());
     }
 
     template<typename T>
-    void add_value_flag(std::vector<std::string> path, int idx, std::string flag, T value) {
+    void add_value_flag(const std::vector<std::string>& path, int idx, std::string_view flag, T value) {
         dispatch_node_t* cur = traverse_entire(path);
-        
+
         if(idx >= cur->num_args) {
             index_failed(idx, cur->num_args);
         }
 
-        cur->args[idx].flags[flag] = value;
+        cur->add_flag(syms_mut().intern(flag), idx, value_t::box(std::move(value)));
     }
 
     template<typename T>
-    void add_default(std::vector<std::string> path, int idx, T def) {
+    void add_default(const std::vector<std::string>& path, int idx, T def) {
         dispatch_node_t* cur = traverse_entire(path);
 
         if(idx >= cur->num_args) {
             index_failed(idx, cur->num_args);
         }
 
-        std::any wrapper(def);
-        cur->add_default(idx, wrapper);
+        cur->add_default(idx, value_t::box(std::move(def)));
     }
 
-    void add_specific_invalid_args_message(std::vector<std::string> path, std::string msg) {
+    void add_specific_invalid_args_message(const std::vector<std::string>& path, std::string msg) {
         dispatch_node_t* cur = traverse_entire(path);
 
-        cur->set_invalid_args_message(msg);
+        cur->invalid_args_msg = std::move(msg);
     }
 
-    void add_specific_invalid_command_message(std::vector<std::string> path, std::string msg) {
+    void add_specific_invalid_command_message(const std::vector<std::string>& path, std::string msg) {
         dispatch_node_t* cur = traverse_entire(path);
 
-        cur->set_invalid_command_message(msg);
+        cur->invalid_command_msg = std::move(msg);
     }
 
     void add_default_invalid_args_message(std::string msg) {
-        invalid_args_msg = msg;
+        invalid_args_msg = std::move(msg);
     }
 
     void add_default_invalid_command_message(std::string msg) {
-        invalid_command_msg = msg;
+        invalid_command_msg = std::move(msg);
     }
 
-    void add_specific_invalid_args_func(std::vector<std::string> path, InvalidArgsFunc func) {
+    void add_specific_invalid_args_func(const std::vector<std::string>& path, InvalidArgsFunc func) {
         dispatch_node_t* cur = traverse_entire(path);
 
-        cur->invalid_args_func = func;
+        cur->invalid_args_func = std::move(func);
     }
 
-    void add_specific_invalid_command_func(std::vector<std::string> path, InvalidCommandFunc func) {
+    void add_specific_invalid_command_func(const std::vector<std::string>& path, InvalidCommandFunc func) {
         dispatch_node_t* cur = traverse_entire(path);
 
-        cur->invalid_command_func = func;
+        cur->invalid_command_func = std::move(func);
     }
 
     void add_default_invalid_args_func(InvalidArgsFunc func) {
-        invalid_args_func = func;
+        invalid_args_func = std::move(func);
     }
 
     void add_default_invalid_command_func(InvalidCommandFunc func) {
-        invalid_command_func = func;
+        invalid_command_func = std::move(func);
+    }
+
+    /// Redirects all dispatcher diagnostics. The sink receives each error as one fully
+    /// formatted block; the default writes it to std::cout with a single write call.
+    void set_error_sink(std::function<void(std::string_view)> sink) {
+        error_sink = std::move(sink);
+    }
+
+    /// Sends pre-formatted text through the configured sink, for custom invalid-command and
+    /// invalid-args handlers that want the same buffered output path as the built-ins.
+    void emit_error(std::string_view text) {
+        error_sink(text);
+    }
+
+    /// Snapshot of one command's counters: dispatch count, time per phase, and a power-of-two
+    /// handler latency histogram (bucket k counts runs that took [2^k, 2^(k+1)) nanoseconds).
+    struct command_stats_t {
+        std::string path;
+        std::uint64_t invocations;
+        std::uint64_t traverse_ns;
+        std::uint64_t bind_ns;
+        std::uint64_t convert_ns;
+        std::uint64_t execute_ns;
+        std::uint64_t execute_hist[24];
+    };
+
+    /// Turns on per-command instrumentation: each dispatch then costs a handful of relaxed
+    /// atomic adds and clock reads, attributed to traversal, flag/positional binding,
+    /// conversion, and handler execution. Call after registration is complete — commands added
+    /// later are not tracked until stats are re-enabled. Define DISPATCHER_NO_STATS to compile
+    /// the hooks out entirely.
+    void enable_stats() {
+#ifndef DISPATCHER_NO_STATS
+        stats_data = std::shared_ptr<node_stats_t[]>(new node_stats_t[node_count]());
+        stats_size = node_count;
+#endif
+    }
+
+    void disable_stats() {
+#ifndef DISPATCHER_NO_STATS
+        stats_data.reset();
+        stats_size = 0;
+#endif
+    }
+
+    /// Snapshot of every command with a handler, in tree order. Safe to call while other
+    /// threads dispatch against a frozen tree; counters are read relaxed, so a snapshot taken
+    /// mid-dispatch may be off by the in-flight invocation.
+    std::vector<command_stats_t> stats() {
+        std::vector<command_stats_t> res;
+#ifndef DISPATCHER_NO_STATS
+        if(stats_data) {
+            collect_stats(0, "", res);
+        }
+#endif
+        return res;
     }
 
-    void set_arg_name(std::vector<std::string> path, int idx, std::string name) {
+    void set_arg_name(const std::vector<std::string>& path, int idx, std::string name) {
         dispatch_node_t* cur = traverse_entire(path);
 
         if(idx >= cur->num_args) {
             index_failed(idx, cur->num_args);
         }
 
-        cur->args[idx].name = name;
+        cur->args[idx].name = std::move(name);
     }
 };
 
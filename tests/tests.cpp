@@ -1,9 +1,26 @@
 #include <gtest/gtest.h>
+#include <atomic>
 #include <string>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <sstream>
+#include <thread>
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
 #include "../dispatcher.h"
 
+static void static_double(int x) {
+    std::cout<<x * 2<<std::endl;
+}
+
+static std::atomic<int> dispatch_counter { 0 };
+
+static void count_dispatch(int x) {
+    dispatch_counter += x;
+}
+
 class DispatcherTests : public ::testing::Test {
 protected:
     std::stringstream input_buffer;
@@ -193,7 +210,7 @@ TEST_F(DispatcherTests, InvalidArgsTest) {
     };
 
     d.add_command({"test"}, func);
-    d.add_target_invalid_args_message({"test"}, "updated message");
+    d.add_specific_invalid_args_message({"test"}, "updated message");
 
     int argc = 3;
     const char* argv[] = {"Dispatcher", "test", "asdlkfjhaslkdjfas"};
@@ -271,6 +288,475 @@ TEST_F(DispatcherTests, ValueFlagTest) {
     EXPECT_EQ(output_buffer.str(), "510\n");
 }
 
+TEST_F(DispatcherTests, StaticCommandTest) {
+    Dispatcher d;
+
+    d.add_command<&static_double>({"bar", "baz", "foo"});
+
+    int argc = 5;
+    const char* argv[] = {"Dispatcher", "bar", "baz", "foo", "500"};
+    d.execute_command(argc, argv);
+
+    EXPECT_EQ(output_buffer.str(), "1000\n");
+}
+
+TEST_F(DispatcherTests, ShellModeTest) {
+    Dispatcher d;
+
+    void (*func)(int) = [](int x) {
+        std::cout<<x * 2<<std::endl;
+    };
+
+    d.add_command({"bar", "baz", "foo"}, func);
+
+    d.execute_line("bar baz foo 500");
+    EXPECT_EQ(output_buffer.str(), "1000\n");
+    output_buffer.str("");
+    output_buffer.clear();
+
+    input_buffer.str("bar baz foo 1\nbar baz foo 2\n");
+    d.run_shell(input_buffer);
+    EXPECT_EQ(output_buffer.str(), "2\n4\n");
+}
+
+TEST_F(DispatcherTests, ConcurrentDispatchTest) {
+    Dispatcher d;
+
+    dispatch_counter = 0;
+    d.add_command({"count"}, count_dispatch);
+    d.freeze();
+
+    EXPECT_THROW(d.add_command({"late"}, count_dispatch), std::logic_error);
+
+    std::vector<std::thread> threads;
+    for(int t = 0; t < 4; t++) {
+        threads.emplace_back([&d]() {
+            for(int i = 0; i < 1000; i++) {
+                d.execute_line("count 1");
+            }
+        });
+    }
+    for(std::thread& t : threads) {
+        t.join();
+    }
+
+    EXPECT_EQ(dispatch_counter, 4000);
+}
+
+TEST_F(DispatcherTests, AsyncExecuteTest) {
+    Dispatcher d;
+
+    dispatch_counter = 0;
+    d.add_command({"count"}, count_dispatch);
+    d.async_workers(2);
+
+    std::vector<std::future<void>> futures;
+    for(int i = 0; i < 50; i++) {
+        futures.push_back(d.execute_line_async("count 1"));
+    }
+    d.wait();
+
+    for(std::future<void>& f : futures) {
+        f.get();
+    }
+
+    EXPECT_EQ(dispatch_counter, 50);
+}
+
+#ifdef __linux__
+static int live_thread_count() {
+    std::ifstream in("/proc/self/status");
+    std::string line;
+    while(std::getline(in, line)) {
+        if(line.rfind("Threads:", 0) == 0) {
+            return std::stoi(line.substr(8));
+        }
+    }
+
+    return -1;
+}
+
+TEST_F(DispatcherTests, AsyncWorkersExitTest) {
+    int before = live_thread_count();
+
+    {
+        Dispatcher d;
+        dispatch_counter = 0;
+        d.add_command({"count"}, count_dispatch);
+        d.async_workers(2);
+        d.execute_line_async("count 1").get();
+        EXPECT_EQ(live_thread_count(), before + 2);
+    }
+
+    // the destructor stops and joins the pool; no threads may outlive the dispatcher
+    EXPECT_EQ(live_thread_count(), before);
+    EXPECT_EQ(dispatch_counter, 1);
+}
+#endif
+
+TEST_F(DispatcherTests, BatchOrderedTest) {
+    Dispatcher d;
+
+    void (*func)(int) = [](int x) {
+        std::cout<<x<<std::endl;
+    };
+
+    d.add_command({"emit"}, func);
+
+    std::vector<std::string> lines = {"emit 1", "emit 2", "emit 3"};
+    d.execute_batch(lines, Dispatcher::batch_policy::ordered, 2);
+
+    EXPECT_EQ(output_buffer.str(), "1\n2\n3\n");
+}
+
+TEST_F(DispatcherTests, SaveLoadTest) {
+    void (*func)(int, int) = [](int x, int y) {
+        std::cout<<x + y<<std::endl;
+    };
+
+    std::string file = ::testing::TempDir() + "dispatcher_tree.bin";
+
+    {
+        Dispatcher d;
+        d.add_command({"test"}, func);
+        d.add_positional_flag({"test"}, 1, "y");
+        d.add_default({"test"}, 0, 20);
+        d.save(file);
+    }
+
+    Dispatcher d;
+    d.load(file);
+    d.bind_command({"test"}, func);
+
+    int argc = 4;
+    const char* argv[] = {"Dispatcher", "test", "-y", "10"};
+    d.execute_command(argc, argv);
+
+    EXPECT_EQ(output_buffer.str(), "30\n");
+}
+
+TEST_F(DispatcherTests, CommandHandleTest) {
+    Dispatcher d;
+
+    void (*func)(int, int) = [](int x, int y) {
+        std::cout<<x + y<<std::endl;
+    };
+
+    d.command({"net", "probe"})
+        .handler(func)
+        .default_(0, 5)
+        .flag(1, "y")
+        .alias("pr");
+
+    int argc = 5;
+    const char* argv[] = {"Dispatcher", "net", "pr", "-y", "20"};
+    d.execute_command(argc, argv);
+
+    EXPECT_EQ(output_buffer.str(), "25\n");
+}
+
+TEST_F(DispatcherTests, CompletionTest) {
+    Dispatcher d;
+
+    void (*func)(int, int) = [](int x, int y) {
+        std::cout<<x + y<<std::endl;
+    };
+
+    d.add_command({"net", "probe"}, func);
+    d.add_command({"net", "ping"}, func);
+    d.add_command({"note"}, func);
+    d.add_alias({"net", "probe"}, "pb");
+    d.add_positional_flag({"net", "probe"}, 1, "verbose");
+
+    std::vector<std::string_view> expected = {"net", "note"};
+    EXPECT_EQ(d.complete("n"), expected);
+
+    expected = {"pb", "ping", "probe"};
+    EXPECT_EQ(d.complete("net "), expected);
+
+    expected = {"-verbose"};
+    EXPECT_EQ(d.complete("net probe -v"), expected);
+
+    // frozen trees answer out of the precomputed per-node tables
+    d.freeze();
+    expected = {"pb", "ping", "probe"};
+    EXPECT_EQ(d.complete("net p"), expected);
+
+    expected = {};
+    EXPECT_EQ(d.complete("bogus "), expected);
+}
+
+TEST_F(DispatcherTests, ConversionCacheTest) {
+    struct tag_t {
+        int a;
+    };
+
+    int parses = 0;
+
+    void (*func)(tag_t) = [](tag_t t) {
+        std::cout<<t.a<<std::endl;
+    };
+
+    Dispatcher d;
+    d.add_conversion<tag_t>([&parses](std::string s) -> tag_t {
+        parses++;
+        return tag_t { stoi(s) };
+    });
+    d.cache_conversions<tag_t>();
+    d.add_command({"tag"}, func);
+
+    for(int i = 0; i < 5; i++) {
+        d.execute_line("tag 7");
+    }
+
+    EXPECT_EQ(output_buffer.str(), "7\n7\n7\n7\n7\n");
+    EXPECT_EQ(parses, 1);
+}
+
+TEST_F(DispatcherTests, VariadicArgsTest) {
+    Dispatcher d;
+
+    void (*func)(std::string, std::vector<int>) = [](std::string op, std::vector<int> xs) {
+        int total = 0;
+        for(int x : xs) {
+            total += x;
+        }
+        std::cout<<op<<total<<std::endl;
+    };
+
+    d.add_command({"fold"}, func);
+
+    d.execute_line("fold sum: 1 2 3 4");
+    EXPECT_EQ(output_buffer.str(), "sum:10\n");
+    output_buffer.str("");
+    output_buffer.clear();
+
+    d.execute_line("fold empty:");
+    EXPECT_EQ(output_buffer.str(), "empty:0\n");
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+TEST_F(DispatcherTests, RunStreamTest) {
+    Dispatcher d;
+
+    void (*func)(std::string) = [](std::string s) {
+        std::cout<<s<<std::endl;
+    };
+
+    d.add_command({"say"}, func);
+
+    // a tiny buffer forces every edge case: a line boundary straddling two reads, a line
+    // longer than the buffer (the resize-doubling path), and an unterminated line at EOF
+    std::string input = "say one\nsay twotwotwotwotwotwotwo\nsay tail";
+
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    ASSERT_EQ(write(fds[1], input.data(), input.size()), static_cast<ssize_t>(input.size()));
+    close(fds[1]);
+
+    d.run_stream(fds[0], 16);
+    close(fds[0]);
+
+    EXPECT_EQ(output_buffer.str(), "one\ntwotwotwotwotwotwotwo\ntail\n");
+}
+#endif
+
+TEST_F(DispatcherTests, LazyCommandsTest) {
+    Dispatcher d;
+
+    void (*func)(int) = [](int x) {
+        std::cout<<x<<std::endl;
+    };
+
+    int factory_runs = 0;
+    d.add_command({"alpha"}, func);
+    d.add_lazy_commands("deferred", [&factory_runs, func](Dispatcher& dd) {
+        factory_runs++;
+        dd.add_command({"deferred", "go"}, func);
+        dd.add_default({"deferred", "go"}, 0, 3);
+    });
+
+    // pending roots show up in the miss listing before anything materializes
+    int argc = 2;
+    const char* argv[] = {"Dispatcher", "zzzzzz"};
+    d.execute_command(argc, argv);
+    EXPECT_EQ(output_buffer.str(), "Unknown command: Dispatcher \x1B[31mzzzzzz\x1B[30m\n\nPossible commands are:\n\talpha\n\tdeferred\n\n");
+    EXPECT_EQ(factory_runs, 0);
+    output_buffer.str("");
+    output_buffer.clear();
+
+    // a root miss runs the factory and dispatches straight into the new subtree
+    d.execute_line("deferred go 9");
+    EXPECT_EQ(output_buffer.str(), "9\n");
+    EXPECT_EQ(factory_runs, 1);
+    output_buffer.str("");
+    output_buffer.clear();
+
+    // the factory's registrations (including defaults) persist after materialization
+    d.execute_line("deferred go");
+    EXPECT_EQ(output_buffer.str(), "3\n");
+    EXPECT_EQ(factory_runs, 1);
+}
+
+TEST_F(DispatcherTests, ConstRefParamTest) {
+    Dispatcher d;
+
+    void (*func)(const std::string&, const int&) = [](const std::string& s, const int& x) {
+        std::cout<<s<<x<<std::endl;
+    };
+
+    d.add_command({"echo"}, func);
+
+    int argc = 4;
+    const char* argv[] = {"Dispatcher", "echo", "hi", "5"};
+    d.execute_command(argc, argv);
+
+    EXPECT_EQ(output_buffer.str(), "hi5\n");
+}
+
+TEST_F(DispatcherTests, CloneTest) {
+    void (*func)(int) = [](int x) {
+        std::cout<<x<<std::endl;
+    };
+
+    Dispatcher base;
+    base.add_command({"job"}, func);
+    base.add_default({"job"}, 0, 1);
+
+    Dispatcher tenant = base.clone();
+    tenant.add_default({"job"}, 0, 2);
+
+    // divergence stays private to each side of the clone
+    base.execute_line("job");
+    tenant.execute_line("job");
+    base.execute_line("job");
+    EXPECT_EQ(output_buffer.str(), "1\n2\n1\n");
+    output_buffer.str("");
+    output_buffer.clear();
+
+    // a clone must outlive its source: registration on the clone copies the symbol table,
+    // and the copy has to own its own lookup keys
+    auto orphan = std::make_unique<Dispatcher>();
+    orphan->add_command({"job", "run"}, func);
+    Dispatcher survivor = orphan->clone();
+    survivor.add_command({"job", "other"}, func);
+    orphan.reset();
+
+    survivor.execute_line("job run 7");
+    survivor.execute_line("job other 8");
+    EXPECT_EQ(output_buffer.str(), "7\n8\n");
+    output_buffer.str("");
+    output_buffer.clear();
+
+    // registration after the source died must not hand overlay-owned indices to new arena
+    // nodes — the earlier "other" command would silently pick up the new handler
+    void (*tripled)(int) = [](int x) {
+        std::cout<<x * 3<<std::endl;
+    };
+    survivor.add_command({"job", "third"}, tripled);
+
+    survivor.execute_line("job other 8");
+    survivor.execute_line("job third 8");
+    EXPECT_EQ(output_buffer.str(), "8\n24\n");
+}
+
+TEST_F(DispatcherTests, FlagSyntaxTest) {
+    Dispatcher d;
+
+    void (*func)(int, int, int) = [](int a, int b, int c) {
+        std::cout<<a<<b<<c<<std::endl;
+    };
+
+    d.add_command({"run"}, func);
+    d.add_value_flag({"run"}, 0, "a", 1);
+    d.add_value_flag({"run"}, 1, "b", 2);
+    d.add_positional_flag({"run"}, 2, "c");
+    d.add_default({"run"}, 0, 0);
+    d.add_default({"run"}, 1, 0);
+    d.add_default({"run"}, 2, 0);
+
+    d.execute_line("run --a=7 -c 9");
+    EXPECT_EQ(output_buffer.str(), "709\n");
+    output_buffer.str("");
+    output_buffer.clear();
+
+    d.execute_line("run -ab");
+    EXPECT_EQ(output_buffer.str(), "120\n");
+    output_buffer.str("");
+    output_buffer.clear();
+
+    // the trailing member of a group may take the next token as its value
+    d.execute_line("run -abc 5");
+    EXPECT_EQ(output_buffer.str(), "125\n");
+}
+
+TEST_F(DispatcherTests, StatsTest) {
+    Dispatcher d;
+
+    dispatch_counter = 0;
+    d.add_command({"count"}, count_dispatch);
+    d.enable_stats();
+    d.freeze();
+
+    for(int i = 0; i < 10; i++) {
+        d.execute_line("count 1");
+    }
+
+    std::vector<Dispatcher::command_stats_t> stats = d.stats();
+    ASSERT_EQ(stats.size(), 1);
+    EXPECT_EQ(stats[0].path, "count");
+    EXPECT_EQ(stats[0].invocations, 10);
+
+    std::uint64_t hist_total = 0;
+    for(int b = 0; b < 24; b++) {
+        hist_total += stats[0].execute_hist[b];
+    }
+    EXPECT_EQ(hist_total, 10);
+}
+
+TEST_F(DispatcherTests, QuietExecuteTest) {
+    Dispatcher d;
+
+    void (*func)(int) = [](int x) {
+        std::cout<<x<<std::endl;
+    };
+
+    d.add_command({"net", "ping"}, func);
+    d.freeze();
+
+    EXPECT_EQ(d.try_execute_line("net ping 5"), Dispatcher::exec_status::ok);
+    EXPECT_EQ(d.try_execute_line("net bogus 5"), Dispatcher::exec_status::no_match);
+    EXPECT_EQ(d.try_execute_line("net ping notanint"), Dispatcher::exec_status::invalid_args);
+
+    // misses produce no suggestions or error output at all
+    EXPECT_EQ(output_buffer.str(), "5\n");
+}
+
+TEST_F(DispatcherTests, ErrorSinkTest) {
+    Dispatcher d;
+
+    void (*func)(void) = []() {
+        std::cout<<"test"<<std::endl;
+    };
+
+    d.add_command({"bar", "baz"}, func);
+
+    std::string captured;
+    int calls = 0;
+    d.set_error_sink([&](std::string_view text) {
+        captured.append(text);
+        calls++;
+    });
+
+    int argc = 4;
+    const char* argv[] = {"Dispatcher", "foo", "bar", "baz"};
+    d.execute_command(argc, argv);
+
+    EXPECT_EQ(calls, 1);
+    EXPECT_EQ(captured, "Unknown command: Dispatcher \x1B[31mfoo\x1B[30m\n\nPossible commands are:\n\tbar\n\n");
+    EXPECT_EQ(output_buffer.str(), "");
+}
+
 TEST_F(DispatcherTests, CustomInvalidCommandFuncTest) {
     Dispatcher d;
 
@@ -279,7 +765,7 @@ TEST_F(DispatcherTests, CustomInvalidCommandFuncTest) {
     };
 
     d.add_command({"test"}, func);
-    d.add_target_invalid_command_func({}, [](std::vector<std::string>&, std::vector<std::string>&, std::string&) -> void {
+    d.add_specific_invalid_command_func({}, [](std::vector<std::string>&, std::vector<std::string>&, std::string&) -> void {
         std::cout << "custom\n";
     });
 